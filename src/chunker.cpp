@@ -0,0 +1,158 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include <thread>
+#include <functional>
+
+#include "chunker.h"
+#include "md5.h"
+#include "trace.h"
+
+// Function for building the gear table (random values per byte, fixed seed so every build chunks the same way)
+static std::array<uint64_t, 256> buildGearTable(){
+    std::array<uint64_t, 256> table;
+    uint64_t state = 0x6376637363646331ULL;
+
+    for(size_t i=0; i<table.size(); i++){
+        // splitmix64
+        state += 0x9E3779B97F4A7C15ULL;
+
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+        table[i] = z ^ (z >> 31);
+    }
+
+    return table;
+}
+
+// Function for building a cut mask with a certain number of bits, spread over the top of the hash
+// bitCount -> number of bits set in the mask (more bits means bigger chunks)
+static uint64_t buildMask(int bitCount){
+    uint64_t mask = 0;
+
+    for(int i=0; i<bitCount; i++){
+        mask |= 1ULL << (63 - i * 2);
+    }
+
+    return mask;
+}
+
+static const std::array<uint64_t, 256> gearTable = buildGearTable();
+
+// Stricter mask before the average size and looser after it (normalised chunking), for log2(CHUNK_AVG_SIZE) = 16
+static const uint64_t maskSmall = buildMask(18);
+static const uint64_t maskLarge = buildMask(14);
+
+// Function for finding the length of the next chunk
+// data -> start of the remaining content
+// length -> number of bytes remaining
+static size_t nextChunkLength(const unsigned char* data, size_t length){
+    if(length <= CHUNK_MIN_SIZE){
+        return length;
+    }
+
+    if(length > CHUNK_MAX_SIZE){
+        length = CHUNK_MAX_SIZE;
+    }
+
+    size_t normalSize = std::min<size_t>(CHUNK_AVG_SIZE, length);
+    uint64_t fingerprint = 0;
+
+    // The first CHUNK_MIN_SIZE bytes can never hold a cut point, so don't bother hashing them
+    size_t i = CHUNK_MIN_SIZE;
+
+    for(; i<normalSize; i++){
+        fingerprint = (fingerprint << 1) + gearTable[data[i]];
+
+        if((fingerprint & maskSmall) == 0){
+            return i + 1;
+        }
+    }
+
+    for(; i<length; i++){
+        fingerprint = (fingerprint << 1) + gearTable[data[i]];
+
+        if((fingerprint & maskLarge) == 0){
+            return i + 1;
+        }
+    }
+
+    return length;
+}
+
+std::vector<ChunkSpan> chunkContent(const std::string& content){
+    TRACE_SPAN("chunkContent", TRACE_HASH);
+    std::vector<ChunkSpan> chunks;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(content.data());
+
+    size_t offset = 0;
+    while(offset < content.size()){
+        size_t length = nextChunkLength(data + offset, content.size() - offset);
+
+        chunks.push_back({offset, length});
+        offset += length;
+    }
+
+    return chunks;
+}
+
+bool isChunkedContent(std::string_view content){
+    return content.size() >= CHUNKED_FILE_SIZE || content.find('\0') != std::string::npos;
+}
+
+std::vector<std::string> storeChunks(std::string storeDirPath, const std::string& content, int* newChunkCount){
+    TRACE_SPAN("storeChunks", TRACE_IO, storeDirPath);
+    std::vector<std::string> chunkHashes;
+    int written = 0;
+
+    std::filesystem::create_directories(storeDirPath);
+
+    for(ChunkSpan chunk : chunkContent(content)){
+        std::string chunkData = content.substr(chunk.offset, chunk.length);
+        std::string chunkHash = md5(chunkData);
+
+        chunkHashes.push_back(chunkHash);
+
+        std::string chunkPath = storeDirPath + "/" + chunkHash;
+
+        if(std::filesystem::exists(chunkPath)){
+            continue;
+        }
+
+        // Write to a temporary file first so a half-written chunk is never picked up
+        // (named per thread, since two threads may be storing the same chunk at once)
+        std::string partPath = chunkPath + ".part" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+        std::ofstream chunkFile(partPath, std::ios::binary);
+        chunkFile.write(chunkData.data(), chunkData.size());
+        chunkFile.close();
+
+        std::filesystem::rename(partPath, chunkPath);
+
+        written++;
+    }
+
+    if(newChunkCount != nullptr){
+        *newChunkCount = written;
+    }
+
+    return chunkHashes;
+}
+
+std::string loadChunks(std::string storeDirPath, const std::vector<std::string>& chunkHashes){
+    TRACE_SPAN("loadChunks", TRACE_IO, storeDirPath);
+    std::string content;
+
+    for(const std::string& chunkHash : chunkHashes){
+        std::ifstream chunkFile(storeDirPath + "/" + chunkHash, std::ios::binary);
+
+        content.append(std::istreambuf_iterator<char>(chunkFile), std::istreambuf_iterator<char>());
+    }
+
+    return content;
+}
@@ -0,0 +1,46 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+// Chunk size limits for content-defined chunking (chunks average around CHUNK_AVG_SIZE bytes)
+#define CHUNK_MIN_SIZE (16 * 1024)
+#define CHUNK_AVG_SIZE (64 * 1024)
+#define CHUNK_MAX_SIZE (256 * 1024)
+
+// Files at least this big (or containing a NUL byte) are stored as a list of chunks instead of line changes
+#define CHUNKED_FILE_SIZE (4 * 1024 * 1024)
+
+// Line that follows the hash in a .changes entry to mark the rest of the entry as chunk hashes
+#define CHUNKED_ENTRY_MARKER "#chunks"
+
+// Struct for storing where a chunk sits in some content
+struct ChunkSpan{
+    size_t offset;
+    size_t length;
+};
+
+// Function for splitting content into chunks using a gear hash (FastCDC), so an edit only changes the chunks around it
+// content -> the content to split
+std::vector<ChunkSpan> chunkContent(const std::string& content);
+
+// Function for checking if content should be stored as chunks rather than line changes
+// content -> the content to check
+bool isChunkedContent(std::string_view content);
+
+// Function for writing the chunks of some content into a chunk store, skipping chunks that are already there
+// Returns the chunk hashes in order
+// storeDirPath -> directory of the chunk store
+// content -> the content to store
+// newChunkCount -> set to the number of chunks that weren't already in the store (optional)
+std::vector<std::string> storeChunks(std::string storeDirPath, const std::string& content, int* newChunkCount = nullptr);
+
+// Function for rebuilding content from chunks in a chunk store
+// storeDirPath -> directory of the chunk store
+// chunkHashes -> hashes of the chunks, in order
+std::string loadChunks(std::string storeDirPath, const std::vector<std::string>& chunkHashes);
+
+#endif
@@ -0,0 +1,433 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "logger.h"
+
+// End-to-end benchmark for the cvcs client
+// Generates synthetic repositories for every combination of file count and save count, runs the client commands
+// against them as separate processes and writes the wall time and peak RSS of each command as JSON
+// Uses fork/exec and wait4, so it only runs on Linux and other POSIX systems
+
+// Struct for storing the benchmark settings
+struct BenchOptions{
+    std::string cvcsPath;
+    std::string workDir;
+    std::string outPath;
+    std::vector<int> fileCounts;
+    std::vector<int> saveCounts;
+    int fileSize;
+    double editFraction;
+    std::string pattern;
+    int repeat;
+};
+
+// Struct for storing how one run of a cvcs command went
+struct CommandRun{
+    double milliseconds;
+    long maxRssKiB;
+    int exitCode;
+};
+
+// Struct for storing every run of one command against one repository
+struct CommandTimings{
+    std::string name;
+    std::vector<double> milliseconds;
+    long maxRssKiB = 0;
+    int failures = 0;
+
+    CommandTimings(const std::string& name) : name(name){}
+};
+
+// Function for making a line of random text
+// rng -> random number generator to use
+// length -> length of the line
+std::string randomLine(std::mt19937_64& rng, int length){
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789 ";
+
+    std::string line(length, ' ');
+    for(char& c : line){
+        c = letters[rng() % (sizeof(letters) - 1)];
+    }
+
+    return line;
+}
+
+// Function for making the starting content of a synthetic file
+// rng -> random number generator to use
+// size -> roughly how big the file should be
+std::string makeFileContent(std::mt19937_64& rng, int size){
+    std::string content;
+
+    while(static_cast<int>(content.size()) < size){
+        content += randomLine(rng, 60) + "\n";
+    }
+
+    content.pop_back();
+
+    return content;
+}
+
+// Function for editing the synthetic files between saves
+// Always changes at least one line, so every save has something in it
+// rng -> random number generator to use
+// contents -> contents of every file in the repository
+// pattern -> "scatter" changes random lines, "append" adds lines to the end, "rewrite" replaces whole files
+// editFraction -> fraction of lines (or files, for "rewrite") to change
+// fileSize -> size to use for rewritten files
+void editFiles(std::mt19937_64& rng, std::vector<std::string>& contents, std::string pattern, double editFraction, int fileSize){
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    for(std::string& content : contents){
+        if(pattern == "rewrite"){
+            if(chance(rng) < editFraction){
+                content = makeFileContent(rng, fileSize);
+            }
+
+        }else if(pattern == "append"){
+            int lineCount = content.size() / 61 + 1;
+            int newLines = static_cast<int>(lineCount * editFraction);
+
+            for(int i=0; i<newLines; i++){
+                content += "\n" + randomLine(rng, 60);
+            }
+
+        }else{
+            // Every line is 60 characters plus a newline, so lines can be swapped in place
+            for(size_t offset=0; offset + 60 <= content.size(); offset += 61){
+                if(chance(rng) < editFraction){
+                    content.replace(offset, 60, randomLine(rng, 60));
+                }
+            }
+        }
+    }
+
+    std::string& content = contents[rng() % contents.size()];
+    size_t lineCount = content.size() / 61 + 1;
+
+    content.replace((rng() % lineCount) * 61, 60, randomLine(rng, 60));
+}
+
+// Function for writing the synthetic files to the repository
+// repoDir -> directory of the repository
+// contents -> contents of every file
+void writeFiles(std::string repoDir, const std::vector<std::string>& contents){
+    for(size_t i=0; i<contents.size(); i++){
+        std::ofstream outFile(repoDir + "/file" + std::to_string(i) + ".txt", std::ios::binary);
+        outFile << contents[i];
+    }
+}
+
+// Function for running the cvcs binary in a repository and measuring it
+// options -> the benchmark settings
+// repoDir -> directory to run the command in
+// arguments -> arguments to pass to cvcs
+// input -> text to give the command on stdin (history reads its commands from there)
+CommandRun runCvcs(const BenchOptions& options, std::string repoDir, std::vector<std::string> arguments, std::string input){
+    std::string inputPath = options.workDir + "/.stdin";
+
+    std::ofstream inputFile(inputPath, std::ios::binary);
+    inputFile << input;
+    inputFile.close();
+
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(options.cvcsPath.c_str()));
+
+    for(std::string& argument : arguments){
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+
+    pid_t pid = fork();
+
+    if(pid < 0){
+        throw std::runtime_error("fork failed");
+    }
+
+    if(pid == 0){
+        int inputFd = open(inputPath.c_str(), O_RDONLY);
+        int nullFd = open("/dev/null", O_WRONLY);
+
+        if(chdir(repoDir.c_str()) != 0 || inputFd < 0 || nullFd < 0){
+            _exit(127);
+        }
+
+        dup2(inputFd, STDIN_FILENO);
+        dup2(nullFd, STDOUT_FILENO);
+        dup2(nullFd, STDERR_FILENO);
+
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    // wait4 gives the resource usage of just this child, rather than every child so far
+    int status = 0;
+    struct rusage usage;
+
+    wait4(pid, &status, 0, &usage);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    int exitCode = WIFEXITED(status) ? static_cast<signed char>(WEXITSTATUS(status)) : -128;
+
+    // ru_maxrss is in KiB on Linux
+    return {elapsed.count(), usage.ru_maxrss, exitCode};
+}
+
+// Function for adding a run to the timings of a command
+// timings -> the timings to add to
+// run -> the run to add
+void recordRun(CommandTimings& timings, CommandRun run){
+    timings.milliseconds.push_back(run.milliseconds);
+    timings.maxRssKiB = std::max(timings.maxRssKiB, run.maxRssKiB);
+
+    if(run.exitCode != 0){
+        timings.failures++;
+    }
+}
+
+// Function for turning the timings of a command into a JSON object
+// timings -> the timings to convert
+std::string timingsToJson(CommandTimings timings){
+    std::vector<double>& sorted = timings.milliseconds;
+    std::sort(sorted.begin(), sorted.end());
+
+    double total = 0.0;
+    for(double milliseconds : sorted){
+        total += milliseconds;
+    }
+
+    double mean = sorted.empty() ? 0.0 : total / sorted.size();
+    double minimum = sorted.empty() ? 0.0 : sorted.front();
+    double maximum = sorted.empty() ? 0.0 : sorted.back();
+    double median = sorted.empty() ? 0.0 : sorted[sorted.size() / 2];
+
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer), "{\"count\": %zu, \"failures\": %d, \"meanMs\": %.3f, \"medianMs\": %.3f, \"minMs\": %.3f, \"maxMs\": %.3f, \"maxRssKiB\": %ld}", sorted.size(), timings.failures, mean, median, minimum, maximum, timings.maxRssKiB);
+
+    return "\"" + timings.name + "\": " + buffer;
+}
+
+// Function for generating one repository and benchmarking every command against it
+// Returns the JSON object for the run
+// options -> the benchmark settings
+// fileCount -> number of files in the repository
+// saveCount -> number of saves to make (including the first, full save)
+std::string benchmarkRepository(const BenchOptions& options, int fileCount, int saveCount){
+    std::string repoDir = options.workDir + "/repo-" + std::to_string(fileCount) + "-" + std::to_string(saveCount);
+
+    std::filesystem::remove_all(repoDir);
+    std::filesystem::create_directories(repoDir);
+
+    std::mt19937_64 rng(fileCount * 7919 + saveCount);
+
+    std::vector<std::string> contents;
+    std::vector<std::string> addArguments = {"add"};
+
+    for(int i=0; i<fileCount; i++){
+        contents.push_back(makeFileContent(rng, options.fileSize));
+        addArguments.push_back("file" + std::to_string(i) + ".txt");
+    }
+
+    writeFiles(repoDir, contents);
+
+    CommandTimings initTimings{"init"};
+    CommandTimings addTimings{"add"};
+    CommandTimings firstSaveTimings{"firstSave"};
+    CommandTimings saveTimings{"save"};
+
+    recordRun(initTimings, runCvcs(options, repoDir, {"init", "."}, ""));
+    recordRun(addTimings, runCvcs(options, repoDir, addArguments, ""));
+    recordRun(firstSaveTimings, runCvcs(options, repoDir, {"save", "bench save 0"}, ""));
+
+    for(int saveID=1; saveID<saveCount; saveID++){
+        editFiles(rng, contents, options.pattern, options.editFraction, options.fileSize);
+        writeFiles(repoDir, contents);
+
+        recordRun(saveTimings, runCvcs(options, repoDir, {"save", "bench save " + std::to_string(saveID)}, ""));
+    }
+
+    CommandTimings statusTimings{"status"};
+    CommandTimings historyTimings{"history"};
+    CommandTimings viewChangesTimings{"viewChanges"};
+    CommandTimings rollbackFirstTimings{"rollbackFirst"};
+    CommandTimings rollbackLastTimings{"rollbackLast"};
+
+    // history reads a command per save from stdin, an empty line moves on to the next save
+    std::string viewEverySave;
+    for(int saveID=0; saveID<saveCount; saveID++){
+        viewEverySave += "v\n\n";
+    }
+
+    for(int i=0; i<options.repeat; i++){
+        // Leave an unsaved edit for status to find (the rollbacks below undo it)
+        editFiles(rng, contents, options.pattern, options.editFraction, options.fileSize);
+        writeFiles(repoDir, contents);
+
+        recordRun(statusTimings, runCvcs(options, repoDir, {"status"}, ""));
+        recordRun(historyTimings, runCvcs(options, repoDir, {"history"}, ""));
+        recordRun(viewChangesTimings, runCvcs(options, repoDir, {"history"}, viewEverySave));
+        recordRun(rollbackFirstTimings, runCvcs(options, repoDir, {"rollback", "0"}, ""));
+        recordRun(rollbackLastTimings, runCvcs(options, repoDir, {"rollback", std::to_string(saveCount - 1)}, ""));
+    }
+
+    std::vector<CommandTimings> allTimings = {initTimings, addTimings, firstSaveTimings, saveTimings, statusTimings, historyTimings, viewChangesTimings, rollbackFirstTimings, rollbackLastTimings};
+
+    std::string json = "    {\"files\": " + std::to_string(fileCount) + ", \"saves\": " + std::to_string(saveCount) + ", \"commands\": {";
+
+    for(size_t i=0; i<allTimings.size(); i++){
+        json += (i > 0 ? ", " : "") + timingsToJson(allTimings[i]);
+
+        if(allTimings[i].failures > 0){
+            error(allTimings[i].name + " failed " + std::to_string(allTimings[i].failures) + " time(s) in " + repoDir);
+        }
+    }
+
+    json += "}}";
+
+    std::filesystem::remove_all(repoDir);
+
+    return json;
+}
+
+// Function for parsing a comma separated list of numbers
+// value -> the list to parse, e.g. 10,100,1000
+std::vector<int> parseList(std::string value){
+    std::vector<int> numbers;
+
+    size_t start = 0;
+    while(start <= value.size()){
+        size_t end = value.find(',', start);
+
+        if(end == std::string::npos){
+            end = value.size();
+        }
+
+        numbers.push_back(std::stoi(value.substr(start, end - start)));
+
+        start = end + 1;
+    }
+
+    return numbers;
+}
+
+// Function for parsing the command line options
+// argc -> argument count
+// argv -> arguments
+// options -> set to the parsed options
+bool parseOptions(int argc, char* argv[], BenchOptions& options){
+    options = {"./cvcs", "/tmp/cvcs-bench-repos", "cvcs-bench.json", {10, 100, 1000}, {10}, 4096, 0.05, "scatter", 3};
+
+    for(int i=1; i<argc; i++){
+        std::string option = argv[i];
+
+        if(i + 1 >= argc){
+            return false;
+        }
+
+        std::string value = argv[++i];
+
+        if(option == "--cvcs"){
+            options.cvcsPath = value;
+        }else if(option == "--work-dir"){
+            options.workDir = value;
+        }else if(option == "--out"){
+            options.outPath = value;
+        }else if(option == "--files"){
+            options.fileCounts = parseList(value);
+        }else if(option == "--saves"){
+            options.saveCounts = parseList(value);
+        }else if(option == "--file-size"){
+            options.fileSize = std::stoi(value);
+        }else if(option == "--edit-fraction"){
+            options.editFraction = std::stod(value);
+        }else if(option == "--pattern"){
+            options.pattern = value;
+        }else if(option == "--repeat"){
+            options.repeat = std::stoi(value);
+        }else{
+            return false;
+        }
+    }
+
+    for(int count : options.fileCounts){
+        if(count <= 0){
+            return false;
+        }
+    }
+
+    for(int count : options.saveCounts){
+        if(count <= 0){
+            return false;
+        }
+    }
+
+    return options.repeat > 0 && options.fileSize > 0 && (options.pattern == "scatter" || options.pattern == "append" || options.pattern == "rewrite");
+}
+
+int main(int argc, char* argv[]){
+    BenchOptions options;
+
+    try{
+        if(!parseOptions(argc, argv, options)){
+            throw std::invalid_argument("bad option");
+        }
+    }catch(std::exception& err){
+        error("Invalid arguments passed. Usage:\ncvcs-bench [--cvcs <path>] [--work-dir <dir>] [--out <file>] [--files <n,n,...>] [--saves <n,n,...>] [--file-size <bytes>] [--edit-fraction <0-1>] [--pattern <scatter|append|rewrite>] [--repeat <n>]");
+        return -1;
+    }
+
+    // Resolve the binary and work directory before the commands are run from inside the repositories
+    options.cvcsPath = std::filesystem::absolute(options.cvcsPath).string();
+    options.workDir = std::filesystem::absolute(options.workDir).string();
+
+    if(!std::filesystem::exists(options.cvcsPath)){
+        error(options.cvcsPath + " does not exist");
+        return -1;
+    }
+
+    std::filesystem::create_directories(options.workDir);
+
+    std::string json = "{\n  \"cvcs\": \"" + options.cvcsPath + "\",\n";
+    json += "  \"fileSize\": " + std::to_string(options.fileSize) + ",\n";
+    json += "  \"editFraction\": " + std::to_string(options.editFraction) + ",\n";
+    json += "  \"pattern\": \"" + options.pattern + "\",\n";
+    json += "  \"repeat\": " + std::to_string(options.repeat) + ",\n";
+    json += "  \"runs\": [\n";
+
+    bool firstRun = true;
+
+    for(int fileCount : options.fileCounts){
+        for(int saveCount : options.saveCounts){
+            log("Benchmarking " + std::to_string(fileCount) + " file(s) with " + std::to_string(saveCount) + " save(s)");
+
+            json += (firstRun ? "" : ",\n") + benchmarkRepository(options, fileCount, saveCount);
+
+            firstRun = false;
+        }
+    }
+
+    json += "\n  ]\n}\n";
+
+    std::ofstream outFile(options.outPath);
+    outFile << json;
+    outFile.close();
+
+    log("Results written to " + options.outPath);
+
+    return 0;
+}
@@ -0,0 +1,383 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <set>
+#include <sstream>
+
+#include "networkUtils.h"
+#include "chunker.h"
+#include "md5.h"
+#include "logger.h"
+
+// Load generator for cvcs-server
+// Runs a number of simulated clients, each with its own session, sending a random mix of upload, list and
+// download requests until the time is up, then prints throughput and latency percentiles for each command
+
+#define SERVER_IP "127.0.0.1"
+#define SERVER_PORT 2956
+
+// Struct for storing the load test settings
+struct LoadTestOptions{
+    std::string serverIP;
+    int clients;
+    int seconds;
+    int uploadWeight;
+    int listWeight;
+    int downloadWeight;
+    int projects;
+    int filesPerUpload;
+    int fileSize;
+    double editFraction;
+};
+
+// The commands a simulated client can send
+enum Command{
+    UPLOAD,
+    LIST,
+    DOWNLOAD,
+    COMMAND_COUNT
+};
+
+const char* commandNames[COMMAND_COUNT] = {"upload", "list", "download"};
+
+// Struct for storing what one simulated client measured
+struct ClientResults{
+    std::vector<double> latencies[COMMAND_COUNT];
+    int errors[COMMAND_COUNT] = {0, 0, 0};
+    long long bytesSent = 0;
+};
+
+// Function for making a line of random text
+// rng -> random number generator to use
+// length -> length of the line
+std::string randomLine(std::mt19937_64& rng, int length){
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789 ";
+
+    std::string line(length, ' ');
+    for(char& c : line){
+        c = letters[rng() % (sizeof(letters) - 1)];
+    }
+
+    return line;
+}
+
+// Function for making the starting content of a synthetic file
+// rng -> random number generator to use
+// size -> roughly how big the file should be
+std::string makeFileContent(std::mt19937_64& rng, int size){
+    std::string content;
+
+    while(static_cast<int>(content.size()) < size){
+        content += randomLine(rng, 60) + "\n";
+    }
+
+    content.pop_back();
+
+    return content;
+}
+
+// Function for changing some of the lines in a synthetic file, like a user editing it between uploads
+// rng -> random number generator to use
+// content -> the file content to edit
+// editFraction -> fraction of lines to change
+void editFileContent(std::mt19937_64& rng, std::string& content, double editFraction){
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    // Every line is 60 characters plus a newline, so lines can be swapped in place
+    for(size_t offset=0; offset + 60 <= content.size(); offset += 61){
+        if(chance(rng) < editFraction){
+            content.replace(offset, 60, randomLine(rng, 60));
+        }
+    }
+}
+
+// Function for doing a whole chunked upload (begin, send missing chunks, commit) in a session
+// Returns the number of bytes of chunk data sent
+// clientSocket -> the session to use
+// projectName -> name of the synthetic project
+// filePaths -> paths of the files being uploaded
+// contents -> contents of the files being uploaded
+long long runUpload(SocketType clientSocket, std::string projectName, const std::vector<std::string>& filePaths, const std::vector<std::string>& contents){
+    std::string manifest = std::to_string(filePaths.size()) + "\n";
+
+    std::vector<std::pair<std::string, std::string_view>> chunks;
+
+    for(size_t i=0; i<filePaths.size(); i++){
+        std::vector<ChunkSpan> spans = chunkContent(contents[i]);
+
+        manifest += filePaths[i] + "\n" + std::to_string(spans.size()) + "\n";
+
+        for(ChunkSpan span : spans){
+            std::string_view chunkData = std::string_view(contents[i]).substr(span.offset, span.length);
+            std::string chunkHash = md5(chunkData);
+
+            manifest += chunkHash + "\n";
+            chunks.push_back({chunkHash, chunkData});
+        }
+    }
+
+    int beginRequestID = sendRequest(clientSocket, "uploadbegin");
+    sendMessage(clientSocket, projectName);
+    sendMessage(clientSocket, "");
+    sendMessage(clientSocket, "load test");
+    sendMessage(clientSocket, manifest);
+
+    SessionReply beginReply = receiveReply(clientSocket, beginRequestID);
+
+    if(!beginReply.ok || beginReply.messages[0] == ""){
+        throw std::runtime_error("uploadbegin refused");
+    }
+
+    std::string sessionID = beginReply.messages[0];
+    std::string missingList = beginReply.messages[1];
+
+    std::set<std::string> missing;
+    std::istringstream missingStream(missingList);
+
+    std::string chunkHash;
+    while(std::getline(missingStream, chunkHash)){
+        missing.insert(chunkHash);
+    }
+
+    // Only send each missing chunk once, even if it appears in several files
+    std::vector<std::pair<std::string, std::string_view>> toSend;
+    for(auto& chunk : chunks){
+        if(missing.erase(chunk.first) > 0){
+            toSend.push_back(chunk);
+        }
+    }
+
+    long long bytesSent = 0;
+
+    // Chunks and commit go out back to back, the server runs them in order
+    int chunksRequestID = sendRequest(clientSocket, "uploadchunks");
+    sendMessage(clientSocket, projectName);
+    sendMessage(clientSocket, sessionID);
+    sendMessage(clientSocket, std::to_string(toSend.size()));
+
+    for(auto& chunk : toSend){
+        sendMessage(clientSocket, chunk.first);
+        sendMessage(clientSocket, chunk.second);
+
+        bytesSent += chunk.second.size();
+    }
+
+    int commitRequestID = sendRequest(clientSocket, "uploadcommit");
+    sendMessage(clientSocket, projectName);
+    sendMessage(clientSocket, sessionID);
+
+    SessionReply chunksReply = receiveReply(clientSocket, chunksRequestID);
+    SessionReply commitReply = receiveReply(clientSocket, commitRequestID);
+
+    if(!chunksReply.ok || !commitReply.ok || std::stoi(commitReply.messages[0]) < 0){
+        throw std::runtime_error("upload failed");
+    }
+
+    return bytesSent;
+}
+
+// Function for running one simulated client until the deadline
+// clientNumber -> which client this is (picks the project and seeds the random numbers)
+// options -> the load test settings
+// deadline -> when to stop sending requests
+// results -> set to what the client measured
+void runClient(int clientNumber, const LoadTestOptions& options, std::chrono::steady_clock::time_point deadline, ClientResults& results){
+    std::mt19937_64 rng(clientNumber * 7919 + 1);
+
+    std::string projectName = "loadtest" + std::to_string(clientNumber % options.projects);
+
+    // Each client keeps its own files, so concurrent uploads to the same project don't all send the same thing
+    std::vector<std::string> filePaths;
+    std::vector<std::string> contents;
+
+    for(int i=0; i<options.filesPerUpload; i++){
+        filePaths.push_back("/" + projectName + "/client" + std::to_string(clientNumber) + "/file" + std::to_string(i) + ".txt");
+        contents.push_back(makeFileContent(rng, options.fileSize));
+    }
+
+    int totalWeight = options.uploadWeight + options.listWeight + options.downloadWeight;
+
+    SocketType clientSocket;
+
+    try{
+        clientSocket = openSession(options.serverIP, SERVER_PORT);
+    }catch(std::exception& err){
+        error("Client " + std::to_string(clientNumber) + " couldn't connect: " + err.what());
+        results.errors[LIST]++;
+        return;
+    }
+
+    while(std::chrono::steady_clock::now() < deadline){
+        int pick = rng() % totalWeight;
+        Command command = (pick < options.uploadWeight) ? UPLOAD : (pick < options.uploadWeight + options.listWeight) ? LIST : DOWNLOAD;
+
+        if(command == UPLOAD){
+            for(std::string& content : contents){
+                editFileContent(rng, content, options.editFraction);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        try{
+            if(command == UPLOAD){
+                results.bytesSent += runUpload(clientSocket, projectName, filePaths, contents);
+
+            }else if(command == LIST){
+                int requestID = sendRequest(clientSocket, "list");
+
+                if(!receiveReply(clientSocket, requestID).ok){
+                    throw std::runtime_error("list failed");
+                }
+
+            }else{
+                int requestID = sendRequest(clientSocket, "download");
+                sendMessage(clientSocket, projectName);
+
+                if(!receiveReply(clientSocket, requestID).ok){
+                    throw std::runtime_error("download failed");
+                }
+            }
+
+        }catch(std::exception& err){
+            results.errors[command]++;
+
+            // The session may be out of step now, so start a new one
+            closeSocket(clientSocket);
+
+            try{
+                clientSocket = openSession(options.serverIP, SERVER_PORT);
+            }catch(std::exception& connectErr){
+                return;
+            }
+
+            continue;
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        results.latencies[command].push_back(elapsed.count());
+    }
+
+    closeSession(clientSocket);
+}
+
+// Function for getting a percentile from sorted latencies
+// sortedLatencies -> the latencies, sorted
+// percentile -> the percentile to get (0 to 1)
+double getPercentile(const std::vector<double>& sortedLatencies, double percentile){
+    if(sortedLatencies.empty()){
+        return 0.0;
+    }
+
+    size_t index = static_cast<size_t>(std::ceil(percentile * sortedLatencies.size()));
+
+    return sortedLatencies[std::min(sortedLatencies.size(), std::max<size_t>(index, 1)) - 1];
+}
+
+// Function for parsing the command line options
+// argc -> argument count
+// argv -> arguments
+// options -> set to the parsed options
+bool parseOptions(int argc, char* argv[], LoadTestOptions& options){
+    options = {SERVER_IP, 8, 10, 1, 4, 1, 4, 20, 4096, 0.05};
+
+    for(int i=1; i<argc; i++){
+        std::string option = argv[i];
+
+        if(i + 1 >= argc){
+            return false;
+        }
+
+        std::string value = argv[++i];
+
+        if(option == "--server"){
+            options.serverIP = value;
+        }else if(option == "--clients"){
+            options.clients = std::stoi(value);
+        }else if(option == "--seconds"){
+            options.seconds = std::stoi(value);
+        }else if(option == "--mix"){
+            // upload:list:download weights, e.g. 1:4:1
+            if(std::sscanf(value.c_str(), "%d:%d:%d", &options.uploadWeight, &options.listWeight, &options.downloadWeight) != 3){
+                return false;
+            }
+        }else if(option == "--projects"){
+            options.projects = std::stoi(value);
+        }else if(option == "--files"){
+            options.filesPerUpload = std::stoi(value);
+        }else if(option == "--file-size"){
+            options.fileSize = std::stoi(value);
+        }else if(option == "--edit-fraction"){
+            options.editFraction = std::stod(value);
+        }else{
+            return false;
+        }
+    }
+
+    return options.clients > 0 && options.projects > 0 && options.uploadWeight + options.listWeight + options.downloadWeight > 0;
+}
+
+int main(int argc, char* argv[]){
+    LoadTestOptions options;
+
+    if(!parseOptions(argc, argv, options)){
+        error("Invalid arguments passed. Usage:\ncvcs-loadtest [--server <ip>] [--clients <n>] [--seconds <n>] [--mix <upload:list:download>] [--projects <n>] [--files <n>] [--file-size <bytes>] [--edit-fraction <0-1>]");
+        return -1;
+    }
+
+    initialiseSockets();
+
+    log("Running " + std::to_string(options.clients) + " client(s) against " + options.serverIP + ":" + std::to_string(SERVER_PORT) + " for " + std::to_string(options.seconds) + "s");
+
+    std::vector<ClientResults> results(options.clients);
+    std::vector<std::thread> clients;
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(options.seconds);
+
+    for(int i=0; i<options.clients; i++){
+        clients.emplace_back(runClient, i, std::cref(options), deadline, std::ref(results[i]));
+    }
+
+    for(std::thread& client : clients){
+        client.join();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Merge what every client measured
+    long long bytesSent = 0;
+
+    std::printf("%-10s %10s %10s %10s %10s %10s %10s\n", "command", "count", "errors", "ops/s", "p50 ms", "p99 ms", "p999 ms");
+
+    for(int command=0; command<COMMAND_COUNT; command++){
+        std::vector<double> latencies;
+        int errors = 0;
+
+        for(ClientResults& clientResults : results){
+            latencies.insert(latencies.end(), clientResults.latencies[command].begin(), clientResults.latencies[command].end());
+            errors += clientResults.errors[command];
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+
+        std::printf("%-10s %10zu %10d %10.1f %10.2f %10.2f %10.2f\n", commandNames[command], latencies.size(), errors, latencies.size() / elapsed.count(), getPercentile(latencies, 0.50), getPercentile(latencies, 0.99), getPercentile(latencies, 0.999));
+    }
+
+    for(ClientResults& clientResults : results){
+        bytesSent += clientResults.bytesSent;
+    }
+
+    log("Uploaded " + std::to_string(bytesSent / 1024) + " KiB of chunk data in " + std::to_string(elapsed.count()) + "s");
+
+    cleanupSockets();
+
+    return 0;
+}
@@ -0,0 +1,302 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <sys/socket.h>
+
+#include "utils.h"
+#include "md5.h"
+#include "networkUtils.h"
+#include "logger.h"
+
+// Microbenchmarks for the core kernels: getChanges, reconstructSplitString, MD5 and message framing
+// Each benchmark is run with a growing number of iterations until it takes long enough to time, then timed once more
+// while counting every call to operator new, and reported as time per op, bytes per second and allocations per op
+// Message framing runs over a socketpair, so it only builds on Linux and other POSIX systems
+
+// Every allocation in the process goes through here, so allocations per op can be counted
+std::atomic<long long> allocationCount{0};
+
+void* operator new(size_t size){
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+
+    if(pointer == nullptr){
+        throw std::bad_alloc();
+    }
+
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept{
+    std::free(pointer);
+}
+
+// Results are added to this so the compiler can't throw the benchmarked work away
+volatile size_t benchmarkSink = 0;
+
+// Struct for storing a registered benchmark
+struct Benchmark{
+    std::string name;
+    // Bytes processed by one op, used for the bytes per second column
+    long long bytesPerOp;
+    // Runs the op the given number of times
+    std::function<void(long long)> run;
+};
+
+// Struct for storing the result of a benchmark
+struct BenchmarkResult{
+    long long iterations;
+    double nanosecondsPerOp;
+    double bytesPerSecond;
+    double allocationsPerOp;
+};
+
+// Function for making a line of random text
+// rng -> random number generator to use
+// length -> length of the line
+std::string randomLine(std::mt19937_64& rng, int length){
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789 ";
+
+    std::string line(length, ' ');
+    for(char& c : line){
+        c = letters[rng() % (sizeof(letters) - 1)];
+    }
+
+    return line;
+}
+
+// Function for making lines of random text
+// rng -> random number generator to use
+// size -> roughly how many bytes the lines should add up to (including newlines)
+std::vector<std::string> makeLines(std::mt19937_64& rng, long long size){
+    std::vector<std::string> lines;
+
+    for(long long total=0; total < size; total += 61){
+        lines.push_back(randomLine(rng, 60));
+    }
+
+    return lines;
+}
+
+// Function for changing a fraction of lines, like a user editing a file between saves
+// rng -> random number generator to use
+// lines -> the lines to edit
+// editDensity -> fraction of lines to change
+std::vector<std::string> editLines(std::mt19937_64& rng, std::vector<std::string> lines, double editDensity){
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    for(std::string& line : lines){
+        if(chance(rng) < editDensity){
+            line = randomLine(rng, 60);
+        }
+    }
+
+    return lines;
+}
+
+// Function for timing a benchmark with a set number of iterations
+// Returns the elapsed time in seconds
+// benchmark -> the benchmark to run
+// iterations -> how many ops to run
+double timeIterations(const Benchmark& benchmark, long long iterations){
+    auto start = std::chrono::steady_clock::now();
+
+    benchmark.run(iterations);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count();
+}
+
+// Function for running a benchmark
+// benchmark -> the benchmark to run
+// minTime -> how long the timed run should take at least, in seconds
+BenchmarkResult runBenchmark(const Benchmark& benchmark, double minTime){
+    // Grow the iteration count until a run is long enough to predict how many iterations minTime needs
+    long long iterations = 1;
+    double elapsed = timeIterations(benchmark, iterations);
+
+    while(elapsed < minTime / 10 && iterations < (1LL << 40)){
+        iterations *= 10;
+        elapsed = timeIterations(benchmark, iterations);
+    }
+
+    iterations = std::max(1LL, static_cast<long long>(iterations * (minTime / std::max(elapsed, 1e-9)) * 1.1));
+
+    long long allocationsBefore = allocationCount.load();
+    elapsed = timeIterations(benchmark, iterations);
+    long long allocations = allocationCount.load() - allocationsBefore;
+
+    return {iterations, elapsed * 1e9 / iterations, benchmark.bytesPerOp * iterations / elapsed, static_cast<double>(allocations) / iterations};
+}
+
+// Function for adding the getChanges benchmarks, for each file size and edit density
+// benchmarks -> the list to add to
+void addGetChangesBenchmarks(std::vector<Benchmark>& benchmarks){
+    for(long long size : {4LL << 10, 64LL << 10, 1LL << 20}){
+        for(double editDensity : {0.001, 0.01, 0.1}){
+            std::mt19937_64 rng(size);
+
+            std::vector<std::string> oldLines = makeLines(rng, size);
+            std::string oldContent = reconstructSplitString(oldLines);
+            std::string newContent = reconstructSplitString(editLines(rng, oldLines, editDensity));
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "getChanges/%lld/%g", size, editDensity);
+
+            benchmarks.push_back({name, static_cast<long long>(oldContent.size() + newContent.size()), [oldContent, newContent](long long iterations){
+                for(long long i=0; i<iterations; i++){
+                    benchmarkSink = benchmarkSink + getChanges(oldContent, newContent).size();
+                }
+            }});
+        }
+    }
+}
+
+// Function for adding the reconstructSplitString benchmarks, for each line count
+// benchmarks -> the list to add to
+void addReconstructBenchmarks(std::vector<Benchmark>& benchmarks){
+    for(long long lineCount : {64LL, 1024LL, 16384LL}){
+        std::mt19937_64 rng(lineCount);
+
+        std::vector<std::string> lines = makeLines(rng, lineCount * 61);
+
+        benchmarks.push_back({"reconstructSplitString/" + std::to_string(lineCount), lineCount * 61, [lines](long long iterations){
+            for(long long i=0; i<iterations; i++){
+                benchmarkSink = benchmarkSink + reconstructSplitString(lines).size();
+            }
+        }});
+    }
+}
+
+// Function for adding the MD5 benchmarks, for each input size
+// benchmarks -> the list to add to
+void addMD5Benchmarks(std::vector<Benchmark>& benchmarks){
+    for(long long size : {64LL, 4LL << 10, 64LL << 10, 1LL << 20}){
+        std::mt19937_64 rng(size);
+
+        std::string input(size, '\0');
+        for(char& c : input){
+            c = static_cast<char>(rng());
+        }
+
+        benchmarks.push_back({"md5/" + std::to_string(size), size, [input](long long iterations){
+            for(long long i=0; i<iterations; i++){
+                benchmarkSink = benchmarkSink + md5(input).size();
+            }
+        }});
+    }
+}
+
+// Function for adding the message framing benchmarks, for each message size
+// One op is a sendMessage on one end of a socketpair and the matching receiveMessage on the other end
+// benchmarks -> the list to add to
+void addFramingBenchmarks(std::vector<Benchmark>& benchmarks){
+    for(long long size : {16LL, 4LL << 10, 64LL << 10, 1LL << 20}){
+        std::string message(size, 'x');
+
+        benchmarks.push_back({"sendMessage+receiveMessage/" + std::to_string(size), size, [message](long long iterations){
+            int sockets[2];
+
+            if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0){
+                throw std::runtime_error("socketpair() failed");
+            }
+
+            // Receive on another thread, so big messages don't fill the socket buffer and block the sender
+            std::thread receiver([&sockets, iterations](){
+                for(long long i=0; i<iterations; i++){
+                    benchmarkSink = benchmarkSink + receiveMessage(sockets[1]).size();
+                }
+            });
+
+            for(long long i=0; i<iterations; i++){
+                sendMessage(sockets[0], message);
+            }
+
+            receiver.join();
+
+            closeSocket(sockets[0]);
+            closeSocket(sockets[1]);
+        }});
+    }
+}
+
+// Function for parsing the command line options
+// argc -> argument count
+// argv -> arguments
+// filter -> set to the text benchmark names have to contain to be run
+// minTime -> set to how long each timed run should take at least, in seconds
+bool parseOptions(int argc, char* argv[], std::string& filter, double& minTime){
+    filter = "";
+    minTime = 0.5;
+
+    for(int i=1; i<argc; i++){
+        std::string option = argv[i];
+
+        if(i + 1 >= argc){
+            return false;
+        }
+
+        std::string value = argv[++i];
+
+        if(option == "--filter"){
+            filter = value;
+        }else if(option == "--min-time"){
+            minTime = std::stod(value);
+        }else{
+            return false;
+        }
+    }
+
+    return minTime > 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string filter;
+    double minTime;
+
+    try{
+        if(!parseOptions(argc, argv, filter, minTime)){
+            throw std::invalid_argument("bad option");
+        }
+    }catch(std::exception& err){
+        error("Invalid arguments passed. Usage:\ncvcs-microbench [--filter <text>] [--min-time <seconds>]");
+        return -1;
+    }
+
+    std::vector<Benchmark> benchmarks;
+
+    addGetChangesBenchmarks(benchmarks);
+    addReconstructBenchmarks(benchmarks);
+    addMD5Benchmarks(benchmarks);
+    addFramingBenchmarks(benchmarks);
+
+    std::printf("%-40s %12s %14s %12s %12s\n", "benchmark", "iterations", "ns/op", "MB/s", "allocs/op");
+
+    for(Benchmark& benchmark : benchmarks){
+        if(benchmark.name.find(filter) == std::string::npos){
+            continue;
+        }
+
+        BenchmarkResult result = runBenchmark(benchmark, minTime);
+
+        std::printf("%-40s %12lld %14.1f %12.1f %12.2f\n", benchmark.name.c_str(), result.iterations, result.nanosecondsPerOp, result.bytesPerSecond / 1e6, result.allocationsPerOp);
+        std::fflush(stdout);
+    }
+
+    return 0;
+}
@@ -6,24 +6,39 @@
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
+#include <set>
+#include <sstream>
+#include <iterator>
+#include <cctype>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <csignal>
+#include <pthread.h>
 
 #include "networkUtils.h"
 #include "utils.h"
 #include "md5.h"
+#include "chunker.h"
+#include "fileCache.h"
+#include "workQueue.h"
+#include "trace.h"
+#include "logger.h"
+#include "metrics.h"
+#include "storageIO.h"
+#include "mappedFile.h"
 
 #define SERVER_PORT 2956
 
-// General logging functions
-
-template <typename T>
-void error(T errMessage){
-    std::cout << "[-] " << errMessage << std::endl;
-}
-
-template <typename T>
-void log(T message){
-    std::cout << "[!] " << message << std::endl;
-}
+// Counters and histograms reported by the "stats" command
+ServerMetrics serverMetrics;
 
 // Function for converting uploaded file path to a local project path
 // projectName -> name of the project that the file is a part of
@@ -65,6 +80,7 @@ std::string convertToServerPath(std::string projectName, std::string filePath) {
 // Function for getting the ID of the last save under a given project
 // projectName -> project to get the last save ID from
 int getLastSaveID(std::string projectName){
+    TRACE_SPAN("getLastSaveID", TRACE_IO, projectName);
     int maxID = -1;
 
     // Iterate over the saves directory
@@ -74,7 +90,7 @@ int getLastSaveID(std::string projectName){
         try{
             int saveID = std::stoi(fileName);
             maxID = std::max(maxID, saveID);
-        }catch(std::invalid_argument e){
+        }catch(std::invalid_argument& err){
             // Ignore non-integer filenames
         }
     }
@@ -82,92 +98,188 @@ int getLastSaveID(std::string projectName){
     return maxID;
 }
 
-// Function for checking if a file has changed from previous save
-// projectName -> name of project the file is a part of
-// filePath -> path to file that is being checked
-bool hasUploadedFileChanged(std::string projectName, std::string serverPath, std::string uploadedContent){
-    std::string oldHash = "";
-    std::string newHash = "";
+// Struct for storing what a project's index knows about a file
+struct IndexEntry{
+    std::string hash;
+
+    // Saves with an entry for the file, oldest first (so rebuilding it only reads those)
+    std::vector<int> saveIDs;
+};
+
+// Struct for storing a project's index: the latest hash of each file and the saves it's in, up to a certain save
+struct ProjectIndex{
+    int lastSaveID;
+    std::unordered_map<std::string, IndexEntry> entries;
+};
+
+// Version of the .index format, written at the start of its first line (an index in any other format is rebuilt)
+#define INDEX_FORMAT_VERSION "v2"
+
+// Function for recording a save's entry for a file in a project's index
+// index -> the index to update
+// serverPath -> path of the file
+// hash -> hash of the file in the save
+// saveID -> ID of the save
+void addIndexEntry(ProjectIndex& index, const std::string& serverPath, const std::string& hash, int saveID){
+    IndexEntry& entry = index.entries[serverPath];
 
-    // Sort directories first to keep oldHash finding updated to the most recent hash
-    std::vector<std::filesystem::__cxx11::directory_entry> directoryEntries;
+    entry.hash = hash;
 
-    for(auto saveDir : std::filesystem::directory_iterator("projects/" + projectName + "/saves/")){
-        directoryEntries.push_back(saveDir);
+    if(entry.saveIDs.empty() || entry.saveIDs.back() != saveID){
+        entry.saveIDs.push_back(saveID);
     }
+}
 
-    // Sort according to the filename of the path, which is the save ID (otherwise would be lexographically)
-    std::sort(directoryEntries.begin(), directoryEntries.end(), [](std::filesystem::__cxx11::directory_entry a, std::filesystem::__cxx11::directory_entry b){
-        return std::stoi(a.path().filename().string()) < std::stoi(b.path().filename().string());
-    });
+// Function for adding the entries of a save to a project's index
+// projectName -> name of the project
+// saveID -> ID of the save to add
+// index -> the index to update
+void addSaveToIndex(std::string projectName, int saveID, ProjectIndex& index){
+    std::ifstream changesFile("projects/" + projectName + "/saves/" + std::to_string(saveID) + "/.changes");
 
-    // Iterate over all change files in order
-    for(auto saveDir : directoryEntries){
-        std::string changesFilePath = saveDir.path().string() + "/.changes";
+    // Each entry is the path, the hash, then lines up to the separator
+    std::string serverPath;
+    while(std::getline(changesFile, serverPath)){
+        std::string hash;
+        std::getline(changesFile, hash);
 
-        std::ifstream changesFile(changesFilePath);
+        addIndexEntry(index, serverPath, hash, saveID);
 
-        // Get the most updated hash
         std::string line;
-        while(std::getline(changesFile, line)){
-            if(line == serverPath){
-                std::getline(changesFile, oldHash);
-                break;
-            }
+        while(std::getline(changesFile, line) && line != "--------------------"){
         }
-
-        changesFile.close();
     }
 
-    log("old hash: " + oldHash);
+    index.lastSaveID = std::max(index.lastSaveID, saveID);
+}
 
-    if(uploadedContent == ""){
-        // Hash of empty string
-        newHash = "d41d8cd98f00b204e9800998ecf8427e";
-    }else{
-        // Calculate new hash
-        newHash = md5(uploadedContent);
-    }
+// Function for writing a project's index to projects/<name>/.index
+// The first line is the format version and the last save covered, then one line per file: hash, the IDs of the
+// saves it's in (separated by commas) and path
+// projectName -> name of the project
+// index -> the index to write
+void writeProjectIndex(std::string projectName, const ProjectIndex& index){
+    TRACE_SPAN("writeProjectIndex", TRACE_IO, projectName);
+    std::string indexPath = "projects/" + projectName + "/.index";
 
-    log("new hash: " + newHash);
+    std::ofstream indexFile(indexPath + ".tmp");
 
-    if(oldHash != newHash && oldHash != ""){
-        return true;
-    }
+    indexFile << INDEX_FORMAT_VERSION << " " << index.lastSaveID << "\n";
 
-    if(oldHash == "" && newHash != ""){
-        return true;
+    for(const auto& [serverPath, entry] : index.entries){
+        indexFile << entry.hash << " ";
+
+        for(size_t i=0; i<entry.saveIDs.size(); i++){
+            indexFile << (i > 0 ? "," : "") << entry.saveIDs[i];
+        }
+
+        indexFile << " " << serverPath << "\n";
     }
 
-    return false;
+    indexFile.close();
+
+    // Replace the old index in one go so a crash never leaves half an index behind
+    std::filesystem::rename(indexPath + ".tmp", indexPath);
 }
 
-// Function for checking if a certain file has a beginning save entry
-// projectName -> name of project that the file is a part of
-// serverPath -> path to file to check
-bool hasNoFullEntry(std::string projectName, std::string serverPath){
-    for(auto saveDir : std::filesystem::directory_iterator("projects/" + projectName + "/saves/")){
-        std::string changesFilePath = saveDir.path().string() + "/.changes"; 
-    
-        if(doesFileExist(changesFilePath)){
-            std::ifstream changesFile(changesFilePath);
+// Function for loading a project's index, building or catching it up from the saves if needed
+// (e.g. the first time a project is used, or if the server stopped between a save and its index update)
+// projectName -> name of the project
+ProjectIndex loadProjectIndex(std::string projectName){
+    TRACE_SPAN("loadProjectIndex", TRACE_IO, projectName);
+    ProjectIndex index = {-1, {}};
 
-            std::string line;
-            while(std::getline(changesFile, line)){
-                if(line == serverPath){
-                    return false;
-                }
+    std::ifstream indexFile("projects/" + projectName + "/.index");
+
+    std::string line;
+    std::string header = INDEX_FORMAT_VERSION " ";
+
+    // An index from an older version of the server is left for the saves to rebuild
+    if(std::getline(indexFile, line) && line.compare(0, header.size(), header) == 0){
+        index.lastSaveID = std::stoi(line.substr(header.size()));
+
+        while(std::getline(indexFile, line)){
+            size_t firstSpace = line.find(' ');
+            size_t secondSpace = line.find(' ', firstSpace + 1);
+
+            if(firstSpace == std::string::npos || secondSpace == std::string::npos){
+                continue;
             }
+
+            IndexEntry entry;
+            entry.hash = line.substr(0, firstSpace);
+
+            std::istringstream saveIDStream(line.substr(firstSpace + 1, secondSpace - firstSpace - 1));
+
+            std::string saveID;
+            while(std::getline(saveIDStream, saveID, ',')){
+                entry.saveIDs.push_back(std::stoi(saveID));
+            }
+
+            index.entries[line.substr(secondSpace + 1)] = entry;
         }
     }
 
-    return true;
+    indexFile.close();
+
+    int lastSaveID = getLastSaveID(projectName);
+
+    if(index.lastSaveID < lastSaveID){
+        log("Updating index for project " + projectName + " from save " + std::to_string(index.lastSaveID + 1) + " to " + std::to_string(lastSaveID));
+
+        for(int saveID = index.lastSaveID + 1; saveID <= lastSaveID; saveID++){
+            addSaveToIndex(projectName, saveID, index);
+        }
+
+        writeProjectIndex(projectName, index);
+    }
+
+    return index;
 }
 
+// Indexes of the projects used since the server started, keyed by project name
+std::map<std::string, ProjectIndex> projectIndexes;
+std::mutex projectIndexesMutex;
+
+// Held while a save is being written and moved into place, so two uploads to a project can't claim the same save ID
+// One per project (kept next to the indexes, under the same mutex), so commits to different projects run side by side
+std::map<std::string, std::mutex> projectCommitMutexes;
+
+// Function for getting the mutex that commits to a project hold
+// projectName -> name of the project
+std::mutex& getProjectCommitMutex(std::string projectName){
+    std::lock_guard<std::mutex> lock(projectIndexesMutex);
+
+    // Map nodes never move, so the mutex can be held after the lookup's lock is let go
+    return projectCommitMutexes[projectName];
+}
+
+// Function for getting a project's index, loading it the first time it's needed
+// Only changed while committing (under the project's commit mutex), so it can be read freely while a save is being written
+// projectName -> name of the project
+ProjectIndex& getProjectIndex(std::string projectName){
+    std::lock_guard<std::mutex> lock(projectIndexesMutex);
+
+    auto found = projectIndexes.find(projectName);
+
+    if(found == projectIndexes.end()){
+        found = projectIndexes.emplace(projectName, loadProjectIndex(projectName)).first;
+    }
+
+    return found->second;
+}
+
+// Most change files read at once while rebuilding a file
+#define REBUILD_READ_BATCH 16
+
 // Function for rebuilding an old version of a file
+// Only the saves the project index lists for the file are read, so the cost follows how often the file has
+// changed rather than how long the project's history is
 // serverPath -> path of file to rebuild
+// fileSaveIDs -> the saves with an entry for the file, oldest first (from the project index)
 // saveIDFinal -> the save ID to rebuild up to (and including)
-std::string rebuildOldFile(std::string projectName, std::string serverPath, int saveIDFinal){
+std::string rebuildOldFile(std::string projectName, std::string serverPath, const std::vector<int>& fileSaveIDs, int saveIDFinal){
+    TRACE_SPAN("rebuildOldFile", TRACE_REBUILD, serverPath);
     if(saveIDFinal < 0){
         // Trying to rebuild when there isn't a previous save to rebuild from
         return "";
@@ -177,74 +289,134 @@ std::string rebuildOldFile(std::string projectName, std::string serverPath, int
     std::vector<Change> changes;
     bool foundContent = false;
 
-    // Sort so it applies changes in the correct order
-    std::vector<std::filesystem::__cxx11::directory_entry> directoryEntries;
+    // Number of entries read for the file, reported as the rebuild depth
+    uint64_t entriesRead = 0;
 
-    for(auto saveDir : std::filesystem::directory_iterator("projects/" + projectName + "/saves/")){
-        directoryEntries.push_back(saveDir);
+    // Content of the latest chunked entry, returned as-is if nothing has changed it since
+    std::string chunkedContent = "";
+    bool lastEntryChunked = false;
+
+    // Saves with an entry for the file, up to (and including) saveIDFinal
+    std::vector<int> saveIDs;
+
+    for(int saveID : fileSaveIDs){
+        if(saveID <= saveIDFinal){
+            saveIDs.push_back(saveID);
+        }
     }
 
-    // Sort according to the filename of the path, which is the save ID (otherwise would be lexographically)
-    std::sort(directoryEntries.begin(), directoryEntries.end(), [](std::filesystem::__cxx11::directory_entry a, std::filesystem::__cxx11::directory_entry b){
-        return std::stoi(a.path().filename().string()) < std::stoi(b.path().filename().string());
-    });
+    for(size_t batchStart=0; batchStart<saveIDs.size(); batchStart+=REBUILD_READ_BATCH){
+        // Read the next few change files together, so the disk works on all of them at once
+        std::vector<std::string> changesFilePaths;
 
-    // Iterate over the save directories in order
-    for(auto saveDir : directoryEntries){
-        // If we have gone past the saveIDFinal, break
-        if(saveDir.path().string() == "projects/" + projectName + "/saves/" + std::to_string(saveIDFinal+1)){
-            break;
+        for(size_t i=batchStart; i<saveIDs.size() && i<batchStart+REBUILD_READ_BATCH; i++){
+            changesFilePaths.push_back("projects/" + projectName + "/saves/" + std::to_string(saveIDs[i]) + "/.changes");
         }
 
-        std::string changesFilePath = saveDir.path().string() + "/.changes";
-    
-        if(doesFileExist(changesFilePath)){
-            std::ifstream changesFile(changesFilePath);
-
-            std::string line;
-            while(std::getline(changesFile, line)){
-                if(line == serverPath){
-                    if(!foundContent){
-                        // Ignore hash
-                        std::getline(changesFile, line);
-
-                        std::string changesLine = "";
-                        while(std::getline(changesFile, changesLine) && changesLine != "--------------------"){
-                            int splitPos = changesLine.find_first_of(':');
-
-                            // Store the content of the original save of the file
-                            oldFileSplit.push_back(changesLine.substr(splitPos+1));
-                        }
+        std::vector<std::string> changesFiles = readStoredFiles(changesFilePaths);
 
-                        foundContent = true;
+        // Iterate over the change files in order
+        for(const std::string& changesFile : changesFiles){
+            LineReader changesLines(changesFile);
 
-                        break;
-                    
-                    }else{
-                        // Ignore hash
-                        std::getline(changesFile, line);
+            std::string_view line;
+            while(changesLines.next(line)){
+                if(line != serverPath){
+                    continue;
+                }
 
-                        std::string changesLine = "";
-                        while(std::getline(changesFile, changesLine) && changesLine != "--------------------"){
-                            int splitPos = changesLine.find_first_of(':');
+                entriesRead++;
 
-                            // Store the change represented by the changesLine
-                            Change change = {std::stoi(changesLine.substr(0, splitPos)), changesLine.substr(splitPos+1)};
-                            changes.push_back(change);
-                        }
+                // Large and binary files are stored as a full list of chunks, which replaces everything before it
+                LineReader entryLines = changesLines;
+                entryLines.next(line);
+
+                std::string_view markerLine;
+                if(entryLines.next(markerLine) && markerLine == CHUNKED_ENTRY_MARKER){
+                    std::vector<std::string> chunkPaths;
+
+                    std::string_view chunkLine;
+                    while(entryLines.next(chunkLine) && chunkLine != "--------------------"){
+                        chunkPaths.push_back("projects/" + projectName + "/chunks/" + std::string(chunkLine));
+                    }
+
+                    chunkedContent = "";
+
+                    for(const std::string& chunk : readStoredFiles(chunkPaths)){
+                        chunkedContent += chunk;
+                    }
+
+                    lastEntryChunked = true;
+                    foundContent = true;
+
+                    oldFileSplit.clear();
+                    changes.clear();
+
+                    break;
+                }
+
+                if(lastEntryChunked){
+                    // Line changes after a chunked entry are relative to the chunked content
+                    std::istringstream chunkedStream(chunkedContent);
+
+                    std::string chunkedLine;
+                    while(std::getline(chunkedStream, chunkedLine)){
+                        oldFileSplit.push_back(chunkedLine);
+                    }
+
+                    lastEntryChunked = false;
+                }
+
+                // Ignore hash
+                changesLines.next(line);
+
+                std::string_view changesLine;
+
+                if(!foundContent){
+                    while(changesLines.next(changesLine) && changesLine != "--------------------"){
+                        size_t splitPos = changesLine.find_first_of(':');
+
+                        // Store the content of the original save of the file
+                        oldFileSplit.push_back(std::string(changesLine.substr(splitPos+1)));
+                    }
+
+                    foundContent = true;
+
+                    break;
+
+                }else{
+                    while(changesLines.next(changesLine) && changesLine != "--------------------"){
+                        size_t splitPos = changesLine.find_first_of(':');
+
+                        // Store the change represented by the changesLine
+                        Change change = {std::stoi(std::string(changesLine.substr(0, splitPos))), std::string(changesLine.substr(splitPos+1))};
+                        changes.push_back(change);
                     }
                 }
             }
         }
     }
 
+    serverMetrics.rebuildDepth.record(entriesRead);
+
+    if(lastEntryChunked){
+        return chunkedContent;
+    }
+
     // Apply the changes
     for(Change change : changes){
-        if(change.lineNum > oldFileSplit.size()){
-            oldFileSplit.resize(change.lineNum);
+        // Line numbers start at 1, so anything else is a broken entry
+        if(change.lineNum < 1){
+            continue;
         }
 
-        oldFileSplit[change.lineNum-1] = change.lineContent;
+        size_t lineNum = static_cast<size_t>(change.lineNum);
+
+        if(lineNum > oldFileSplit.size()){
+            oldFileSplit.resize(lineNum);
+        }
+
+        oldFileSplit[lineNum-1] = change.lineContent;
     }
 
     std::string oldFileUpdated = reconstructSplitString(oldFileSplit);
@@ -252,155 +424,1139 @@ std::string rebuildOldFile(std::string projectName, std::string serverPath, int
     return oldFileUpdated;
 }
 
-int main(int argc, char* argv[]){
-    log("Checking if projects directory exists");
-    
-    bool projectsFound = false;
-    for(auto file : std::filesystem::directory_iterator(std::filesystem::current_path())){
-        std::string fileName = file.path().filename().string();
+// Struct for storing a file received from the client as part of an upload
+struct UploadedFile{
+    std::string filePath;
+    std::string content;
+    std::string serverPath;
+    std::string hash;
+    bool stored;
 
-        if(fileName == "projects"){
-            projectsFound = true;
+    // Whether content was kept once the file was written out (see writeSave)
+    bool contentKept;
+};
+
+// Function type for handing the next uploaded file to writeSave, returns false once there are none left
+typedef std::function<bool(UploadedFile&)> FileSource;
+
+// Most uploaded files waiting to be processed at once
+#define DIFF_QUEUE_SIZE 64
+
+// Most content (in bytes) kept in the cache of latest file versions
+#define FILE_CACHE_MAX_BYTES (256 * 1024 * 1024)
+
+// Latest saved version of recently uploaded files, keyed by server path
+FileCache fileCache(FILE_CACHE_MAX_BYTES);
+
+// Function for creating the project file structure if it doesn't exist yet
+// projectName -> name of the project to set up
+void createProjectIfMissing(std::string projectName){
+    // Create project folder
+    std::filesystem::create_directory("projects/" + projectName);
+
+    // Create saves folder
+    std::filesystem::create_directory("projects/" + projectName + "/saves");
+
+    // Create staging folder (upload sessions and saves are written here before being moved into saves/)
+    std::filesystem::create_directory("projects/" + projectName + "/staging");
+
+    // Create chunk store (chunks of large and binary files, shared between saves)
+    std::filesystem::create_directory("projects/" + projectName + "/chunks");
+
+    // Create committed folder (the save each committed upload session became, so a retried commit isn't saved twice)
+    std::filesystem::create_directory("projects/" + projectName + "/committed");
+}
+
+// How long an upload session can go without any chunks arriving before it's removed with its staged chunks (in seconds)
+#define UPLOAD_SESSION_EXPIRY_SECONDS (24 * 60 * 60)
+
+// How long a committed upload session is remembered for, so a retried commit still gets the same save (in seconds)
+#define COMMITTED_MARKER_EXPIRY_SECONDS (7 * 24 * 60 * 60)
+
+// Struct for storing what an upload session was committed as
+struct CommittedUpload{
+    int saveID;
+
+    // Hash of the session's manifest, so a retry with different files isn't mistaken for the same upload
+    std::string manifestHash;
+};
+
+// Function for finding out if an upload session has been committed
+// Returns false if it hasn't
+// projectName -> name of the project the session is for
+// sessionID -> ID of the session (must already be checked with isHexDigest)
+// committed -> set to what the session was committed as
+bool getCommittedUpload(std::string projectName, std::string sessionID, CommittedUpload& committed){
+    std::ifstream markerFile("projects/" + projectName + "/committed/" + sessionID);
+
+    std::string line;
+    if(!std::getline(markerFile, line)){
+        return false;
+    }
+
+    try{
+        committed.saveID = std::stoi(line);
+    }catch(std::logic_error& err){
+        return false;
+    }
+
+    std::getline(markerFile, committed.manifestHash);
+
+    return true;
+}
+
+// Function for removing everything in a directory that hasn't been modified for a while
+// Returns how many entries were removed
+// dirPath -> the directory to clear out
+// maxAgeSeconds -> how long an entry can go unmodified before it's removed
+int removeExpiredEntries(std::string dirPath, int maxAgeSeconds){
+    auto cutoff = std::filesystem::file_time_type::clock::now() - std::chrono::seconds(maxAgeSeconds);
+    int removed = 0;
+
+    // Error codes rather than exceptions, as another connection can be removing or committing the same entries
+    std::error_code errorCode;
+
+    for(auto entry : std::filesystem::directory_iterator(dirPath, errorCode)){
+        auto lastWriteTime = std::filesystem::last_write_time(entry.path(), errorCode);
+
+        if(!errorCode && lastWriteTime < cutoff && std::filesystem::remove_all(entry.path(), errorCode) > 0){
+            removed++;
         }
     }
 
-    if(!projectsFound){
-        log("Creating projects directory");
-        std::filesystem::create_directory("projects");
+    return removed;
+}
+
+// Function for removing a project's abandoned upload sessions and old committed markers
+// Sessions are touched every time chunks arrive for them, so only ones nobody has sent anything to in
+// UPLOAD_SESSION_EXPIRY_SECONDS are removed
+// projectName -> name of the project to clear out
+void expireUploads(std::string projectName){
+    int sessionsRemoved = removeExpiredEntries("projects/" + projectName + "/staging", UPLOAD_SESSION_EXPIRY_SECONDS);
+    int markersRemoved = removeExpiredEntries("projects/" + projectName + "/committed", COMMITTED_MARKER_EXPIRY_SECONDS);
+
+    if(sessionsRemoved > 0 || markersRemoved > 0){
+        log("Removed " + std::to_string(sessionsRemoved) + " expired upload session(s) and " + std::to_string(markersRemoved) + " committed marker(s) from project " + projectName);
     }
+}
 
-    int serverSocketFD = socket(AF_INET, SOCK_STREAM, 0);
+// Function for working out the .changes entry for an uploaded file (empty if nothing needs storing)
+// Also fills in the file's server path and hash
+// projectName -> name of the project the file is a part of
+// previousSaveID -> ID of the last committed save
+// uploadedFile -> the uploaded file
+std::string processUploadedFile(std::string projectName, int previousSaveID, UploadedFile& uploadedFile){
+    TRACE_SPAN("processUploadedFile", TRACE_DIFF, uploadedFile.filePath);
+    std::ostringstream entry;
 
-    char* ip = argv[1];
+    LOG_DEBUG(uploadedFile.filePath + " from project " + projectName + " has been uploaded");
 
-    sockaddr_in serverAddress;
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_port = htons(SERVER_PORT);
-    inet_pton(AF_INET, ip, &serverAddress.sin_addr);
+    std::string serverPath = convertToServerPath(projectName, uploadedFile.filePath);
 
-    bind(serverSocketFD, (struct sockaddr*)&serverAddress, sizeof(serverAddress));
+    LOG_DEBUG("Server path is: " + serverPath);
 
-    listen(serverSocketFD, 10);
+    if(uploadedFile.content != ""){
+        TRACE_SPAN("md5", TRACE_HASH);
+        uploadedFile.hash = md5(uploadedFile.content);
+    }else{
+        // Hash of empty string
+        uploadedFile.hash = "d41d8cd98f00b204e9800998ecf8427e";
+    }
 
-    log("Waiting for connections on " + std::string(ip) + ":" + std::to_string(SERVER_PORT));
+    uploadedFile.serverPath = serverPath;
+    uploadedFile.stored = false;
 
-    int clientSocketFD = accept(serverSocketFD, nullptr, nullptr);
+    serverMetrics.filesProcessed.fetch_add(1, std::memory_order_relaxed);
 
-    std::string command = receiveMessage(clientSocketFD);
+    // If the latest version is cached there's no need to go through the history at all
+    CachedFile cachedFile;
+    bool cacheHit = fileCache.get(serverPath, cachedFile);
 
-    if(command == "upload"){
-        std::string projectName = receiveMessage(clientSocketFD);
-        int fileCount = std::stoi(receiveMessage(clientSocketFD));
-        std::string saveMessage = receiveMessage(clientSocketFD);
-
-        // Check if project exists
-        bool foundProject = false;
-        for(auto file : std::filesystem::directory_iterator("projects")){
-            if(file.path().filename().string() == projectName){
-                foundProject = true;
+    (cacheHit ? serverMetrics.cacheHits : serverMetrics.cacheMisses).fetch_add(1, std::memory_order_relaxed);
+
+    // Otherwise the index has the latest hash
+    const ProjectIndex& index = getProjectIndex(projectName);
+    auto indexEntry = index.entries.find(serverPath);
+    bool hasEntry = cacheHit || indexEntry != index.entries.end();
+
+    std::string oldHash = cacheHit ? cachedFile.hash : (hasEntry ? indexEntry->second.hash : "");
+
+    LOG_DEBUG("old hash: " + oldHash);
+    LOG_DEBUG("new hash: " + uploadedFile.hash);
+
+    bool fileChanged = oldHash != uploadedFile.hash;
+
+    // Check if file has been changed
+    if(fileChanged){
+        log("File has changed: " + serverPath);
+
+        uploadedFile.stored = true;
+
+        // Store path and hash of file
+        entry << serverPath << std::endl;
+        entry << uploadedFile.hash << std::endl;
+
+        if(isChunkedContent(uploadedFile.content)){
+            // Store large and binary files as chunks, only writing the chunks the store doesn't have yet
+            int newChunkCount = 0;
+            std::vector<std::string> chunkHashes = storeChunks("projects/" + projectName + "/chunks", uploadedFile.content, &newChunkCount);
+
+            entry << CHUNKED_ENTRY_MARKER << std::endl;
+
+            for(std::string chunkHash : chunkHashes){
+                entry << chunkHash << std::endl;
             }
-        }
 
-        if(!foundProject){
-            // Set up the project file structure
+            entry << "--------------------" << std::endl;
 
-            // Create project folder
-            std::filesystem::create_directory("projects/" + projectName);
-            
-            // Create saves folder
-            std::filesystem::create_directory("projects/" + projectName + "/saves");
+            log("Stored " + std::to_string(newChunkCount) + " new chunk(s) of " + std::to_string(chunkHashes.size()) + " for " + serverPath);
+
+            return entry.str();
         }
 
-        int saveID = getLastSaveID(projectName) + 1;
+        std::string rebuiltFile;
+
+        if(cacheHit){
+            rebuiltFile = cachedFile.content;
+        }else{
+            // A file that isn't in the index has never been saved, so there are no saves to read
+            std::vector<int> fileSaveIDs = indexEntry != index.entries.end() ? indexEntry->second.saveIDs : std::vector<int>();
 
-        // Create current save directory
-        std::filesystem::create_directory("projects/" + projectName + "/saves/" + std::to_string(saveID));
+            rebuiltFile = rebuildOldFile(projectName, serverPath, fileSaveIDs, previousSaveID);
+
+            LOG_DEBUG("Rebuilt file: " + rebuiltFile);
+        }
 
-        // Create changes file
-        std::ofstream changesFile("projects/" + projectName + "/saves/" + std::to_string(saveID) + "/.changes");
+        LineTable changes = getChanges(rebuiltFile, uploadedFile.content);
 
-        // Create save file
-        std::ofstream saveFile("projects/" + projectName + "/saves/" + std::to_string(saveID) + "/.save");
+        for(std::string_view change : changes){
+            entry << change << std::endl;
+        }
 
-        log("Opening save file at " + ("projects/" + projectName) + "/saves/" + std::to_string(saveID) + "/.save");
+        entry << "--------------------" << std::endl;
 
-        saveFile << getDateTime();
-        saveFile << saveMessage;
+    }else if(!hasEntry){
+        log("File has no full entry (first time saving): " + serverPath);
 
-        saveFile.close();
+        uploadedFile.stored = true;
 
-        for(int i=0; i<fileCount; i++){
-            std::string filePath = receiveMessage(clientSocketFD);
-            std::string uploadedContent = receiveMessage(clientSocketFD);
+        entry << serverPath << std::endl;
+        entry << md5(uploadedFile.content) << std::endl;
+        entry << uploadedFile.content << std::endl;
+        entry << "--------------------" << std::endl;
 
-            log(filePath + " from project " + projectName + " has been uploaded");
+    }
 
-            log("File path is: " + filePath);
+    return entry.str();
+}
 
-            std::string serverPath = convertToServerPath(projectName, filePath);
+// Struct for storing a processed file waiting to be written out
+struct ProcessedFile{
+    std::string entry;
+    UploadedFile file;
+};
 
-            log("Server path is: " + serverPath);
+// Function for getting the queue of the diff workers, shared by every upload
+// The workers (one per core) are started the first time it's used and run for as long as the server does
+BoundedQueue<std::function<void()>>& getDiffWorkers(){
+    // Never freed, as the workers wait on it for as long as the server runs
+    static BoundedQueue<std::function<void()>>* queue = new BoundedQueue<std::function<void()>>(DIFF_QUEUE_SIZE);
+    static std::once_flag started;
 
-            // Check if file has been changed
-            if(hasUploadedFileChanged(projectName, serverPath, uploadedContent)){
-                log("File has changed: " + serverPath);
+    std::call_once(started, [](){
+        unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency());
 
-                // Store path and hash of file
-                changesFile << serverPath << std::endl;
+        for(unsigned int i=0; i<workerCount; i++){
+            std::thread([](){
+                std::function<void()> task;
 
-                if(uploadedContent != ""){
-                    changesFile << md5(uploadedContent) << std::endl;
-                }else{
-                    // Hash of empty string
-                    changesFile << "d41d8cd98f00b204e9800998ecf8427e" << std::endl;
+                while(queue->pop(task)){
+                    task();
                 }
+            }).detach();
+        }
+    });
+
+    return *queue;
+}
+
+// Function for writing the .changes and .save files for a set of uploaded files
+// Files are handed from nextFile to the shared diff workers, so hashing, rebuilding and diffing run in parallel, and
+// the entries are written to .changes in upload order as they finish. At most DIFF_QUEUE_SIZE files are handed out
+// ahead of the next one to be written, so only that many are held at once however big the upload is
+// projectName -> name of the project the files are a part of
+// saveDirPath -> directory to write the save into
+// saveMessage -> message attached to the save
+// nextFile -> gives the next uploaded file, returns false once there are none left
+// processedFiles -> set to the processed files, in upload order (with their content only kept while it fits in the cache)
+void writeSave(std::string projectName, std::string saveDirPath, std::string saveMessage, FileSource nextFile, std::vector<UploadedFile>& processedFiles){
+    TRACE_SPAN("writeSave", TRACE_IO, saveDirPath);
+    LOG_DEBUG("Writing save file at " + saveDirPath + "/.save");
+
+    writeStoredFiles({{saveDirPath + "/.save", getDateTime() + saveMessage}});
+
+    // Create changes file
+    std::ofstream changesFile(saveDirPath + "/.changes");
+
+    // The save being written isn't in saves/ yet, so the last save there is the previous one
+    int previousSaveID = getLastSaveID(projectName);
 
-                std::string rebuiltFile = rebuildOldFile(projectName, serverPath, getLastSaveID(projectName)-1);
+    BoundedQueue<std::function<void()>>& workers = getDiffWorkers();
 
-                log("Rebuilt file: " + rebuiltFile);
+    std::map<size_t, ProcessedFile> results;
+    std::mutex resultsMutex;
+    std::condition_variable resultReady;
 
-                std::vector<std::string> changes = getChanges(rebuiltFile, uploadedContent);
+    size_t fileCount = 0;
+    size_t nextIndex = 0;
+    bool allQueued = false;
+    std::exception_ptr failure = nullptr;
 
-                for(std::string change : changes){
-                    changesFile << change << std::endl;
+    std::thread producer([&](){
+        size_t index = 0;
+
+        try{
+            while(true){
+                {
+                    // Wait for the writer to catch up, so finished files don't pile up behind a slow one
+                    std::unique_lock<std::mutex> lock(resultsMutex);
+
+                    resultReady.wait(lock, [&](){
+                        return index < nextIndex + DIFF_QUEUE_SIZE;
+                    });
                 }
 
-                changesFile << "--------------------" << std::endl;
+                // Shared so the task can be copied into the queue
+                std::shared_ptr<UploadedFile> uploadedFile = std::make_shared<UploadedFile>();
+
+                if(!nextFile(*uploadedFile)){
+                    break;
+                }
+
+                size_t fileIndex = index++;
+
+                workers.push([&, fileIndex, uploadedFile](){
+                    std::string entry = "";
+
+                    try{
+                        entry = processUploadedFile(projectName, previousSaveID, *uploadedFile);
 
-            }else if(hasNoFullEntry(projectName, serverPath)){
-                log("File has no full entry (first time saving): " + serverPath);
-            
-                changesFile << serverPath << std::endl;
-                changesFile << md5(uploadedContent) << std::endl;
-                changesFile << uploadedContent << std::endl;
-                changesFile << "--------------------" << std::endl;
-            
+                    }catch(...){
+                        std::lock_guard<std::mutex> lock(resultsMutex);
+
+                        if(!failure){
+                            failure = std::current_exception();
+                        }
+                    }
+
+                    std::lock_guard<std::mutex> lock(resultsMutex);
+                    results[fileIndex] = {entry, std::move(*uploadedFile)};
+                    resultReady.notify_all();
+                });
             }
 
-            changesFile.close();
+        }catch(...){
+            std::lock_guard<std::mutex> lock(resultsMutex);
+
+            if(!failure){
+                failure = std::current_exception();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        fileCount = index;
+        allQueued = true;
+        resultReady.notify_all();
+    });
+
+    // Bytes of content kept for the cache so far
+    size_t keptBytes = 0;
+
+    // Write entries out in upload order as soon as the next one is ready
+    while(true){
+        ProcessedFile processedFile;
+
+        {
+            std::unique_lock<std::mutex> lock(resultsMutex);
+
+            resultReady.wait(lock, [&](){
+                return results.count(nextIndex) > 0 || (allQueued && nextIndex == fileCount);
+            });
+
+            if(results.count(nextIndex) == 0){
+                break;
+            }
+
+            processedFile = std::move(results[nextIndex]);
+            results.erase(nextIndex);
+
+            // Lets the producer hand out another file
+            nextIndex++;
+            resultReady.notify_all();
+        }
+
+        changesFile << processedFile.entry;
+
+        // Anything past what the cache can hold would only be evicted again, so it's dropped now
+        UploadedFile& uploadedFile = processedFile.file;
+        uploadedFile.contentKept = keptBytes + uploadedFile.content.size() <= FILE_CACHE_MAX_BYTES;
+
+        if(uploadedFile.contentKept){
+            keptBytes += uploadedFile.content.size();
+        }else{
+            std::string().swap(uploadedFile.content);
+        }
+
+        processedFiles.push_back(std::move(uploadedFile));
+    }
+
+    producer.join();
+
+    changesFile.close();
+
+    if(failure){
+        std::rethrow_exception(failure);
+    }
+}
+
+// Function for committing an upload as a new save
+// Writes the save into the staging area first and then renames it into saves/, so other
+// readers either see the whole save or none of it
+// projectName -> name of the project to commit to
+// uploadID -> ID of the staging directory to build the save in (removed once committed)
+// saveMessage -> message attached to the save
+// manifestHash -> hash of the upload's manifest ("" for uploads without one), kept with the record of the commit
+// nextFile -> gives the next uploaded file, returns false once there are none left
+int commitUpload(std::string projectName, std::string uploadID, std::string saveMessage, std::string manifestHash, FileSource nextFile){
+    TRACE_SPAN("commitUpload", TRACE_COMMAND, projectName);
+    auto commitStart = std::chrono::steady_clock::now();
 
-            log("Saved successfully");
+    std::lock_guard<std::mutex> lock(getProjectCommitMutex(projectName));
+
+    createProjectIfMissing(projectName);
+
+    // Already committed (the client is retrying after losing the reply), so hand back the same save
+    CommittedUpload committed;
+
+    if(getCommittedUpload(projectName, uploadID, committed)){
+        log("Upload " + uploadID + " was already committed as save " + std::to_string(committed.saveID));
+        return committed.saveID;
+    }
+
+    std::string stagingDirPath = "projects/" + projectName + "/staging/" + uploadID;
+    std::string saveDirPath = stagingDirPath + "/save";
+
+    std::filesystem::create_directories(stagingDirPath);
+    std::filesystem::remove_all(saveDirPath);
+    std::filesystem::create_directory(saveDirPath);
+
+    std::vector<UploadedFile> files;
+    writeSave(projectName, saveDirPath, saveMessage, nextFile, files);
+
+    int saveID = getLastSaveID(projectName) + 1;
+
+    std::filesystem::rename(saveDirPath, "projects/" + projectName + "/saves/" + std::to_string(saveID));
+
+    // Recorded straight away, as the staging directory a retry would otherwise find is removed below
+    writeStoredFiles({{"projects/" + projectName + "/committed/" + uploadID, std::to_string(saveID) + "\n" + manifestHash + "\n"}});
+
+    // The save is visible now, so these are the latest versions
+    ProjectIndex& index = getProjectIndex(projectName);
+
+    uint64_t filesStored = 0;
+
+    for(UploadedFile& uploadedFile : files){
+        if(uploadedFile.contentKept){
+            fileCache.put(uploadedFile.serverPath, uploadedFile.content, uploadedFile.hash);
+        }else{
+            // Whatever was cached for it is out of date now
+            fileCache.erase(uploadedFile.serverPath);
         }
 
+        if(uploadedFile.stored){
+            filesStored++;
+
+            addIndexEntry(index, uploadedFile.serverPath, uploadedFile.hash, saveID);
+        }
+    }
+
+    index.lastSaveID = saveID;
+    writeProjectIndex(projectName, index);
+
+    std::filesystem::remove_all(stagingDirPath);
+
+    std::chrono::duration<double, std::micro> commitTime = std::chrono::steady_clock::now() - commitStart;
+
+    serverMetrics.filesStored.fetch_add(filesStored, std::memory_order_relaxed);
+    serverMetrics.recordCommit(projectName, static_cast<uint64_t>(commitTime.count()), filesStored);
+
+    log("Saved successfully as save " + std::to_string(saveID));
+
+    return saveID;
+}
+
+// Function for marking an upload session as still in use, so it isn't expired
+// sessionDirPath -> the session's staging directory
+void touchUploadSession(std::string sessionDirPath){
+    std::error_code errorCode;
+    std::filesystem::last_write_time(sessionDirPath, std::filesystem::file_time_type::clock::now(), errorCode);
+}
+
+// Function for creating a new upload ID
+// projectName -> name of the project being uploaded to
+std::string createUploadID(std::string projectName){
+    static std::atomic<unsigned long> uploadCounter{0};
+
+    std::string seed = projectName + getDateTime() + std::to_string(uploadCounter++) + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+
+    return md5(seed);
+}
+
+// Function for checking that a string is an MD5 hex digest (used for upload IDs and chunk hashes)
+// hash -> the string to check
+bool isHexDigest(std::string hash){
+    if(hash.size() != 32){
+        return false;
+    }
+
+    return std::all_of(hash.begin(), hash.end(), [](char c){
+        return std::isxdigit(static_cast<unsigned char>(c));
+    });
+}
+
+// Function for checking that a project name can be used as a single directory name
+// projectName -> the name to check
+bool isValidProjectName(std::string projectName){
+    return projectName != "" && projectName != "." && projectName != ".." && projectName.find('/') == std::string::npos;
+}
+
+// Struct for storing a file in an upload manifest
+struct ManifestEntry{
+    std::string filePath;
+    std::vector<std::string> chunkHashes;
+};
+
+// Function for parsing an upload manifest sent by the client
+// The manifest is the file count, then for each file its path, chunk count and chunk hashes, one per line
+// manifest -> the manifest text
+std::vector<ManifestEntry> parseManifest(std::string manifest){
+    std::vector<ManifestEntry> entries;
+    std::istringstream manifestStream(manifest);
+
+    std::string line;
+    std::getline(manifestStream, line);
+    int fileCount = std::stoi(line);
+
+    for(int i=0; i<fileCount; i++){
+        ManifestEntry entry;
+        std::getline(manifestStream, entry.filePath);
+
+        std::getline(manifestStream, line);
+        int chunkCount = std::stoi(line);
+
+        for(int j=0; j<chunkCount; j++){
+            std::getline(manifestStream, line);
+
+            if(!isHexDigest(line)){
+                throw std::runtime_error("Invalid chunk hash in manifest");
+            }
+
+            entry.chunkHashes.push_back(line);
+        }
+
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+// Function for getting the chunks in a manifest that are neither staged nor already in the project's chunk store
+// projectName -> name of the project being uploaded to
+// chunksDirPath -> the session's chunk directory
+// entries -> the parsed manifest
+std::vector<std::string> getMissingChunks(std::string projectName, std::string chunksDirPath, const std::vector<ManifestEntry>& entries){
+    TRACE_SPAN("getMissingChunks", TRACE_IO, projectName);
+    std::vector<std::string> missing;
+    std::set<std::string> seen;
+
+    std::string storeDirPath = "projects/" + projectName + "/chunks";
+
+    for(const ManifestEntry& entry : entries){
+        for(const std::string& chunkHash : entry.chunkHashes){
+            if(seen.insert(chunkHash).second && !doesFileExist(chunksDirPath + "/" + chunkHash) && !doesFileExist(storeDirPath + "/" + chunkHash)){
+                missing.push_back(chunkHash);
+            }
+        }
+    }
+
+    return missing;
+}
+
+// Function for handling the start of a chunked upload
+// The client sends its manifest (and the session ID of an earlier attempt, if it has one), and gets back the
+// session ID and the chunks the server still needs. Once the client has sent those with uploadchunks, it
+// sends uploadcommit to build the save
+// Chunks are staged in projects/<name>/staging/<sessionID>/chunks, so a dropped upload can be resumed
+// Chunks already in the project's chunk store (from earlier saves of large or binary files) are never asked for
+// clientSocketFD -> socket of the connected client
+std::vector<std::string> handleUploadBegin(int clientSocketFD){
+    std::string projectName = receiveMessage(clientSocketFD);
+    std::string sessionID = receiveMessage(clientSocketFD);
+    std::string saveMessage = receiveMessage(clientSocketFD);
+    std::string manifest = receiveMessage(clientSocketFD);
+
+    if(!isValidProjectName(projectName)){
+        error("Invalid project name: " + projectName);
+        return {"", ""};
+    }
+
+    createProjectIfMissing(projectName);
+
+    expireUploads(projectName);
+
+    CommittedUpload committed;
+
+    if(isHexDigest(sessionID) && getCommittedUpload(projectName, sessionID, committed)){
+        if(committed.manifestHash == md5(manifest)){
+            // The commit went through but the client never heard back, nothing needs sending before it commits again
+            log("Upload session " + sessionID + " for project " + projectName + " was already committed");
+            return {sessionID, ""};
+        }
+
+        // The files have changed since, so this is a new upload
+        sessionID = "";
+    }
+
+    std::string sessionDirPath = "projects/" + projectName + "/staging/" + sessionID;
+
+    if(!isHexDigest(sessionID) || !doesFileExist(sessionDirPath)){
+        sessionID = createUploadID(projectName);
+        sessionDirPath = "projects/" + projectName + "/staging/" + sessionID;
+
+        log("Starting upload session " + sessionID + " for project " + projectName);
+    }else{
+        log("Resuming upload session " + sessionID + " for project " + projectName);
+
+        touchUploadSession(sessionDirPath);
+    }
+
+    std::string chunksDirPath = sessionDirPath + "/chunks";
+    std::filesystem::create_directories(chunksDirPath);
+
+    std::vector<ManifestEntry> entries = parseManifest(manifest);
+
+    // Keep the manifest and message with the session for uploadcommit
+    writeStoredFiles({{sessionDirPath + "/.manifest", manifest}, {sessionDirPath + "/.message", saveMessage}});
+
+    std::vector<std::string> missing = getMissingChunks(projectName, chunksDirPath, entries);
+
+    log(std::to_string(missing.size()) + " chunk(s) needed for upload session " + sessionID);
+
+    std::string missingList;
+    for(const std::string& chunkHash : missing){
+        missingList += chunkHash + "\n";
+    }
+
+    return {sessionID, missingList};
+}
+
+// Function for handling the end of a chunked upload, building the save from the staged chunks
+// Replies with the save ID, or -1 if chunks are still missing
+// clientSocketFD -> socket of the connected client
+std::vector<std::string> handleUploadCommit(int clientSocketFD){
+    std::string projectName = receiveMessage(clientSocketFD);
+    std::string sessionID = receiveMessage(clientSocketFD);
+
+    std::string sessionDirPath = "projects/" + projectName + "/staging/" + sessionID;
+    std::string chunksDirPath = sessionDirPath + "/chunks";
+
+    CommittedUpload committed;
+
+    if(isValidProjectName(projectName) && isHexDigest(sessionID) && getCommittedUpload(projectName, sessionID, committed)){
+        log("Upload session " + sessionID + " was already committed as save " + std::to_string(committed.saveID));
+        return {std::to_string(committed.saveID)};
+    }
+
+    if(!isValidProjectName(projectName) || !isHexDigest(sessionID) || !doesFileExist(sessionDirPath + "/.manifest")){
+        error("Commit for unknown upload session " + sessionID);
+        return {"-1"};
+    }
+
+    std::vector<std::string> sessionFiles = readStoredFiles({sessionDirPath + "/.manifest", sessionDirPath + "/.message"});
+    std::string manifest = sessionFiles[0];
+    std::string saveMessage = sessionFiles[1];
+
+    std::vector<ManifestEntry> entries = parseManifest(manifest);
+
+    // Make sure everything actually arrived before building the save
+    std::vector<std::string> missing = getMissingChunks(projectName, chunksDirPath, entries);
+
+    if(missing.size() > 0){
+        error("Upload session " + sessionID + " is still missing " + std::to_string(missing.size()) + " chunk(s)");
+        return {"-1"};
+    }
+
+    // Files are put back together from their chunks as the workers ask for them
+    size_t entryIndex = 0;
+
+    int saveID = commitUpload(projectName, sessionID, saveMessage, md5(manifest), [&](UploadedFile& uploadedFile){
+        if(entryIndex == entries.size()){
+            return false;
+        }
+
+        const ManifestEntry& entry = entries[entryIndex++];
+        uploadedFile = {entry.filePath, "", "", "", false, false};
+
+        std::vector<std::string> chunkPaths;
+
+        for(const std::string& chunkHash : entry.chunkHashes){
+            std::string chunkPath = chunksDirPath + "/" + chunkHash;
+
+            if(!doesFileExist(chunkPath)){
+                // Already stored by an earlier save
+                chunkPath = "projects/" + projectName + "/chunks/" + chunkHash;
+            }
+
+            chunkPaths.push_back(chunkPath);
+        }
+
+        // Read the file's chunks together rather than one after another
+        for(const std::string& chunk : readStoredFiles(chunkPaths)){
+            uploadedFile.content += chunk;
+        }
+
+        return true;
+    });
+
+    return {std::to_string(saveID)};
+}
+
+// Function for reading a count sent by the client (of the messages that follow it)
+// Throws ConnectionError if it isn't a count, as there's then no telling where the request ends
+// clientSocketFD -> socket of the connected client
+int receiveCount(int clientSocketFD){
+    std::string countMessage = receiveMessage(clientSocketFD);
+
+    try{
+        size_t countLength = 0;
+        int count = std::stoi(countMessage, &countLength);
+
+        if(countLength == countMessage.size() && count >= 0){
+            return count;
+        }
+    }catch(std::logic_error& err){
+    }
+
+    throw ConnectionError("Invalid count: " + countMessage);
+}
+
+// Function for handling a request that sends chunks for a chunked upload
+// Each chunk is checked against its hash and only moved into place once fully written, so anything
+// in the chunks directory is safe to skip when resuming
+// clientSocketFD -> socket of the connected client
+std::vector<std::string> handleUploadChunks(int clientSocketFD){
+    std::string projectName = receiveMessage(clientSocketFD);
+    std::string sessionID = receiveMessage(clientSocketFD);
+    int chunkCount = receiveCount(clientSocketFD);
+
+    std::string chunksDirPath = "projects/" + projectName + "/staging/" + sessionID + "/chunks";
+    bool knownSession = isValidProjectName(projectName) && isHexDigest(sessionID) && doesFileExist(chunksDirPath);
+
+    if(!knownSession){
+        error("Received chunks for unknown upload session " + sessionID);
+    }else{
+        touchUploadSession("projects/" + projectName + "/staging/" + sessionID);
+    }
+
+    // Chunks waiting to be written, by hash
+    std::set<std::string> chunkHashes;
+    std::vector<StorageWrite> chunkWrites;
+
+    // Function for writing the waiting chunks at once, then moving them into place
+    auto writeChunks = [&](){
+        writeStoredFiles(chunkWrites);
+
+        for(const std::string& chunkHash : chunkHashes){
+            std::filesystem::rename(chunksDirPath + "/" + chunkHash + ".part", chunksDirPath + "/" + chunkHash);
+        }
+
+        chunkHashes.clear();
+        chunkWrites.clear();
+    };
+
+    // First write to fail, thrown once every chunk has been read
+    std::exception_ptr failure = nullptr;
+
+    for(int i=0; i<chunkCount; i++){
+        std::string chunkHash = receiveMessage(clientSocketFD);
+        std::string chunkData = receiveMessage(clientSocketFD);
+
+        // Still have to read the chunks for an unknown session (or after a failed write), or the next request would be out of step
+        if(!knownSession || failure){
+            continue;
+        }
+
+        if(!isHexDigest(chunkHash) || md5(chunkData) != chunkHash){
+            error("Chunk " + chunkHash + " doesn't match its hash, dropping it");
+            continue;
+        }
+
+        if(!chunkHashes.insert(chunkHash).second){
+            // Sent twice in one go
+            continue;
+        }
+
+        chunkWrites.push_back({chunksDirPath + "/" + chunkHash + ".part", std::move(chunkData)});
+
+        // Write a ring's worth at a time, so a big upload isn't all held in memory
+        if(chunkWrites.size() == STORAGE_IO_QUEUE_DEPTH){
+            try{
+                writeChunks();
+            }catch(...){
+                failure = std::current_exception();
+            }
+        }
+    }
+
+    if(failure){
+        std::rethrow_exception(failure);
+    }
+
+    writeChunks();
+
+    return {knownSession ? "ok" : "unknown upload"};
+}
+
+// Function for handling a single-stream upload (every file sent whole on one connection)
+// clientSocketFD -> socket of the connected client
+std::vector<std::string> handleUpload(int clientSocketFD){
+    std::string projectName = receiveMessage(clientSocketFD);
+    int fileCount = receiveCount(clientSocketFD);
+    std::string saveMessage = receiveMessage(clientSocketFD);
+
+    int filesReceived = 0;
+
+    // Files are handed to the workers as they arrive, so receiving the rest overlaps diffing the first ones
+    FileSource nextFile = [&](UploadedFile& uploadedFile){
+        if(filesReceived == fileCount){
+            return false;
+        }
+
+        filesReceived++;
+
+        std::string filePath = receiveMessage(clientSocketFD);
+        uploadedFile = {filePath, receiveMessage(clientSocketFD), "", "", false, false};
+
+        return true;
+    };
+
+    // Function for reading whatever files haven't been received yet, so the next request isn't out of step
+    auto skipRemainingFiles = [&](){
+        UploadedFile skippedFile;
+
+        while(nextFile(skippedFile)){
+        }
+    };
+
+    if(!isValidProjectName(projectName)){
+        skipRemainingFiles();
+        throw std::runtime_error("Invalid project name: " + projectName);
+    }
+
+    try{
+        commitUpload(projectName, createUploadID(projectName), saveMessage, "", nextFile);
+
+    }catch(...){
+        skipRemainingFiles();
+        throw;
+    }
+
+    return {};
+}
+
+// Function for reading the rest of a command from the client and running it
+// Returns the messages to reply with
+// command -> the command to run
+// clientSocketFD -> socket of the connected client
+std::vector<std::string> dispatchCommand(std::string command, int clientSocketFD){
+    if(command == "upload"){
+        return handleUpload(clientSocketFD);
+
+    }else if(command == "uploadbegin"){
+        return handleUploadBegin(clientSocketFD);
+
+    }else if(command == "uploadchunks"){
+        return handleUploadChunks(clientSocketFD);
+
+    }else if(command == "uploadcommit"){
+        return handleUploadCommit(clientSocketFD);
+
     }else if(command == "download"){
         std::string projectName = receiveMessage(clientSocketFD);
 
         // Search for project and send over all project files
-    
+
+        return {};
+
     }else if(command == "list"){
         std::vector<std::string> projects;
         for(auto filePath : std::filesystem::directory_iterator(std::filesystem::current_path())){
             projects.push_back(filePath.path().filename().string());
         }
 
-        sendMessage(clientSocketFD, projects.size());
-        
+        std::vector<std::string> replies = {std::to_string(projects.size())};
+
         for(std::string project : projects){
-            sendMessage(clientSocketFD, project);
+            replies.push_back(project);
+        }
+
+        return replies;
+
+    }else if(command == "stats"){
+        return {serverMetrics.toJson()};
+    }
+
+    throw std::runtime_error("Unknown command: " + command);
+}
+
+// Function for running a command and recording how long it took in the server's metrics
+// Returns the messages to reply with
+// command -> the command to run
+// clientSocketFD -> socket of the connected client
+std::vector<std::string> runCommand(std::string command, int clientSocketFD){
+    TRACE_SPAN("runCommand", TRACE_COMMAND, command);
+
+    auto start = std::chrono::steady_clock::now();
+
+    try{
+        std::vector<std::string> replies = dispatchCommand(command, clientSocketFD);
+
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        serverMetrics.recordCommand(command, static_cast<uint64_t>(elapsed.count()), true);
+
+        return replies;
+
+    }catch(...){
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        serverMetrics.recordCommand(command, static_cast<uint64_t>(elapsed.count()), false);
+
+        throw;
+    }
+}
+
+// Function for writing the server's metrics to a file every so often
+// statsFilePath -> file to write the metrics to (replaced each time)
+// intervalSeconds -> seconds between writes
+void dumpStatsPeriodically(std::string statsFilePath, int intervalSeconds){
+    while(true){
+        std::this_thread::sleep_for(std::chrono::seconds(intervalSeconds));
+
+        // Write next to it and rename, so readers never see a half written file
+        std::string tmpPath = statsFilePath + ".tmp";
+
+        std::ofstream statsFile(tmpPath);
+        statsFile << serverMetrics.toJson();
+        statsFile.close();
+
+        std::filesystem::rename(tmpPath, statsFilePath);
+    }
+}
+
+// Function for handling a keep-alive session (after the client has sent "hello")
+// The client sends the protocol version, then any number of requests, each being a request ID, the command and
+// its arguments. Requests can be sent without waiting for replies; they're run in order and each reply is the
+// request ID, the number of reply messages (-1 if the request failed, followed by the error) and the messages.
+// The session ends when the client sends a "close" request
+// clientSocketFD -> socket of the connected client
+void handleSession(int clientSocketFD){
+    std::string clientVersion = receiveMessage(clientSocketFD);
+
+    sendMessage(clientSocketFD, "hello");
+    sendMessage(clientSocketFD, SESSION_PROTOCOL_VERSION);
+
+    if(clientVersion != SESSION_PROTOCOL_VERSION){
+        error("Client uses session protocol version " + clientVersion + ", closing");
+        return;
+    }
+
+    while(true){
+        std::string requestID = receiveMessage(clientSocketFD);
+        std::string command = receiveMessage(clientSocketFD);
+
+        if(command == "close"){
+            sendMessage(clientSocketFD, requestID);
+            sendMessage(clientSocketFD, "0");
+            return;
+        }
+
+        std::vector<std::string> replies;
+
+        try{
+            replies = runCommand(command, clientSocketFD);
+
+        }catch(ConnectionError& err){
+            // Nothing more can be read from or sent to this client
+            throw;
+
+        }catch(std::exception& err){
+            // Only this request failed, and it has been read in full, so the session carries on
+            error("Request " + requestID + " (" + command + ") failed: " + err.what());
+
+            sendMessage(clientSocketFD, requestID);
+            sendMessage(clientSocketFD, "-1");
+            sendMessage(clientSocketFD, err.what());
+            continue;
+        }
+
+        sendMessage(clientSocketFD, requestID);
+        sendMessage(clientSocketFD, std::to_string(replies.size()));
+
+        for(std::string reply : replies){
+            sendMessage(clientSocketFD, reply);
+        }
+    }
+}
+
+// Function for handling a single client connection
+// A connection either starts a session with "hello", or sends one command and is closed after it
+// clientSocketFD -> socket of the connected client
+void handleClient(int clientSocketFD){
+    try{
+        std::string command = receiveMessage(clientSocketFD);
+
+        if(command == "hello"){
+            handleSession(clientSocketFD);
+
+        }else{
+            for(std::string reply : runCommand(command, clientSocketFD)){
+                sendMessage(clientSocketFD, reply);
+            }
+        }
+
+    }catch(std::exception& err){
+        error(std::string("Connection failed: ") + err.what());
+    }
+
+    close(clientSocketFD);
+}
+
+int main(int argc, char* argv[]){
+    // "--trace <file>" records a trace until the server is stopped with Ctrl+C or SIGTERM
+    startTracingFromArguments(argc, argv);
+
+    std::string statsFilePath = "";
+    int statsIntervalSeconds = 60;
+
+    for(int i=2; i+1<argc; i+=2){
+        LogLevel logLevel;
+
+        if(std::string(argv[i]) == "--log-level" && parseLogLevel(argv[i+1], logLevel)){
+            setLogLevel(logLevel);
+        }else if(std::string(argv[i]) == "--stats-file"){
+            statsFilePath = argv[i+1];
+        }else if(std::string(argv[i]) == "--stats-interval"){
+            statsIntervalSeconds = std::max(1, std::atoi(argv[i+1]));
+        }else{
+            argc = 0;
+        }
+    }
+
+    if(argc < 2 || argc % 2 != 0){
+        error("Invalid arguments passed. Usage:\ncvcs-server <ip> [--trace <file>] [--stats-file <file>] [--stats-interval <seconds>] [--log-level <debug|info|error>]");
+        return -1;
+    }
+
+    if(tracingEnabled){
+        // Block the stop signals in every thread, so the thread below is the only one that gets them
+        sigset_t stopSignals;
+        sigemptyset(&stopSignals);
+        sigaddset(&stopSignals, SIGINT);
+        sigaddset(&stopSignals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+        std::thread([stopSignals](){
+            int signal = 0;
+            sigwait(&stopSignals, &signal);
+
+            log("Writing trace and stopping");
+            stopTracing();
+            flushLogs();
+
+            _exit(0);
+        }).detach();
+    }
+
+    // Started after the stop signals are blocked, so they still only go to the trace thread
+    if(statsFilePath != ""){
+        std::thread(dumpStatsPeriodically, statsFilePath, statsIntervalSeconds).detach();
+    }
+
+    // Log lines are handed to a background thread from here on, so connection threads never wait on stdout
+    startLogWriter();
+
+    log("Checking if projects directory exists");
+    
+    bool projectsFound = false;
+    for(auto file : std::filesystem::directory_iterator(std::filesystem::current_path())){
+        std::string fileName = file.path().filename().string();
+
+        if(fileName == "projects"){
+            projectsFound = true;
+        }
+    }
+
+    if(!projectsFound){
+        log("Creating projects directory");
+        std::filesystem::create_directory("projects");
+    }
+
+    // Clear out uploads abandoned while the server was down, each project is checked again whenever an upload starts
+    for(auto projectDir : std::filesystem::directory_iterator("projects")){
+        if(projectDir.is_directory()){
+            expireUploads(projectDir.path().filename().string());
         }
     }
 
+    log("Reading and writing saves through " + std::string(getStorageBackendName()));
+
+    int serverSocketFD = socket(AF_INET, SOCK_STREAM, 0);
+
+    // Allow restarting straight away, without waiting for old connections to time out
+    int reuseAddress = 1;
+    setsockopt(serverSocketFD, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+    char* ip = argv[1];
+
+    sockaddr_in serverAddress;
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(SERVER_PORT);
+    inet_pton(AF_INET, ip, &serverAddress.sin_addr);
+
+    if(bind(serverSocketFD, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) != 0){
+        error("Cannot bind to " + std::string(ip) + ":" + std::to_string(SERVER_PORT));
+        return -1;
+    }
+
+    listen(serverSocketFD, 10);
+
+    log("Waiting for connections on " + std::string(ip) + ":" + std::to_string(SERVER_PORT));
+
+    // Each connection gets its own thread, since a parallel upload needs several connections open at once
+    while(true){
+        int clientSocketFD = accept(serverSocketFD, nullptr, nullptr);
+
+        if(clientSocketFD < 0){
+            error("accept() failed");
+            break;
+        }
+
+        // Requests and replies are small messages, so don't hold them back waiting to fill a packet
+        setNoDelay(clientSocketFD);
+
+        std::thread(handleClient, clientSocketFD).detach();
+    }
+
     close(serverSocketFD);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -7,25 +7,28 @@
 #include <cctype>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
+#include <future>
 
 #include "md5.h"
 #include "networkUtils.h"
 #include "utils.h"
+#include "chunker.h"
+#include "trace.h"
+#include "logger.h"
+#include "watcher.h"
+#include "ignoreRules.h"
+#include "reverseDeltas.h"
+#include "saveFilters.h"
+#include "mappedFile.h"
+#include "repository.h"
+#include "filePipeline.h"
 
 #define SERVER_IP "127.0.0.1"
 #define SERVER_PORT 2956
 
-// General logging functions
-
-template <typename T>
-void error(T errMessage){
-    std::cout << "[-] " << errMessage << std::endl;
-}
-
-template <typename T>
-void log(T message){
-    std::cout << "[!] " << message << std::endl;
-}
+// Maximum number of connections a single upload is split across
+#define UPLOAD_STREAMS 4
 
 // Function for initialising cvcs
 // directory -> directory to initialise in
@@ -78,187 +81,281 @@ int initialise(std::string directory){
     }
 }
 
-// Function for getting the ID of the last save
-int getLastSaveID(){
-    int maxID = -1;
-
-    // Iterate over the saves directory
-    for(auto file : std::filesystem::directory_iterator(std::filesystem::current_path().string() + "/.cupy/saves")){
-        std::string fileName = file.path().filename().string();
+// Function for checking if a certain file is being tracked
+// filePath -> path to file to check
+// trackedSet -> the tracked files (the project's trackedSet)
+bool isFileTracked(const std::string& filePath, const std::unordered_set<std::string>& trackedSet){
+    return trackedSet.count(filePath) > 0;
+}
 
-        try{
-            int saveID = std::stoi(fileName);
-            maxID = std::max(maxID, saveID);
-        }catch(std::invalid_argument e){
-            // Ignore non-integer filenames
+// Function for checking if a path is inside a .cupy directory (or is one)
+// Only a whole ".cupy" path component counts, so files like .cupyignore can still be tracked
+// filePath -> path to check
+bool isInCupyDirectory(const std::string& filePath){
+    for(const std::filesystem::path& component : std::filesystem::path(filePath)){
+        if(component == ".cupy"){
+            return true;
         }
     }
 
-    return maxID;
+    return false;
 }
 
-// Function for getting all the current tracked files
-std::vector<std::string> getTrackedFiles(){
-    std::vector<std::string> trackedFiles;
-
-    std::ifstream trackFile(".cupy/.track");
-    
-    std::string line;
-    while (std::getline(trackFile, line)) {
-        trackedFiles.push_back(line);
+// Function to start tracking a single file
+// trackedSet -> the tracked files (the project's trackedSet)
+// newFiles -> files that have started being tracked but aren't in .track yet
+int trackNewFile(std::string filePathToAdd, std::unordered_set<std::string>& trackedSet, std::vector<std::string>& newFiles){
+    if(isInCupyDirectory(filePathToAdd)){
+        log(".cupy file detected, not adding to track");
+        return 0;
     }
 
-    return trackedFiles;
-}
-
-// Function for getting all files in a directory
-// directory -> directory to search in for all the files
-std::vector<std::string> getAllFiles(std::string directory){
-    std::vector<std::string> allFiles;
-
-    // Iterate over the directory and add the path of the file to the return vector
-    for(auto file : std::filesystem::recursive_directory_iterator(directory)){
-        allFiles.push_back(file.path().string());
+    if(isFileTracked(filePathToAdd, trackedSet)){
+        log(filePathToAdd + " is already being tracked");
+        return 0;
     }
 
-    return allFiles;
-}
+    if(doesFileExist(filePathToAdd)){
+        trackedSet.insert(filePathToAdd);
+        newFiles.push_back(filePathToAdd);
 
-// Function for checking if a certain file is being tracked
-// filePath -> path to file to check
-bool isFileTracked(std::string filePath){
-    std::ifstream trackFile(".cupy/.track");
+    }else{
+        error(filePathToAdd + " does not exist");
 
-    std::string line;
-    while(std::getline(trackFile, line)){
-        if(line == '[' + filePath){
-            return true;
-        }
+        return -1;
     }
 
-    return false;
+    log(filePathToAdd + " added to tracking");
+
+    return 0;
 }
 
 // Function to start tracking a file/directory
+// Newly tracked files are added to trackedSet and newFiles, and only written to .track by writeNewTrackedFiles
 // fileToAdd -> the path of the file/directory to start tracking
-int addFileToTrack(std::string filePathToAdd){
-    if(filePathToAdd.find(".cupy") != std::string::npos){
-        log(".cupy file detected, not adding to track");
+// ignoreRules -> the project's ignore rules, from loadIgnoreRules
+// trackedSet -> the tracked files (the project's trackedSet)
+// newFiles -> files that have started being tracked but aren't in .track yet
+int addFileToTrack(std::string filePathToAdd, const IgnoreRules& ignoreRules, std::unordered_set<std::string>& trackedSet, std::vector<std::string>& newFiles){
+    bool isDirectory = std::filesystem::is_directory(filePathToAdd);
+
+    if(isIgnoredPath(ignoreRules, filePathToAdd, isDirectory)){
+        log(filePathToAdd + " is ignored by " IGNORE_FILE_NAME ", not adding to track");
         return 0;
     }
 
-    if(isFileTracked(filePathToAdd)){
-        log(filePathToAdd + " is already being tracked");
+    // If filePathToAdd is a directory, start tracking all of the files inside the directory that aren't ignored
+    if(isDirectory){
+        forEachUnignoredFile(ignoreRules, filePathToAdd, [&trackedSet, &newFiles](const std::string& filePath){
+            trackNewFile(filePath, trackedSet, newFiles);
+        });
+
         return 0;
     }
 
-    // If filePathToAdd is a directory, start tracking all of the files inside the directory
-    if(std::filesystem::is_directory(filePathToAdd)){
-        for(auto file : std::filesystem::recursive_directory_iterator(filePathToAdd)){
-            addFileToTrack(file.path().string());
-        }
+    return trackNewFile(filePathToAdd, trackedSet, newFiles);
+}
 
-        return 0;
+// Function for appending newly tracked files to .track in a single write
+// newFiles -> files to append
+void writeNewTrackedFiles(const std::vector<std::string>& newFiles){
+    if(newFiles.empty()){
+        return;
     }
 
-    if(doesFileExist(filePathToAdd)){
-        std::ofstream trackFile(".cupy/.track", std::ios::app);
-        trackFile << filePathToAdd << std::endl;
+    std::string lines;
+    for(const std::string& newFile : newFiles){
+        lines += newFile + "\n";
+    }
 
-    }else{
-        error(filePathToAdd + " does not exist");
+    std::ofstream trackFile(".cupy/.track", std::ios::app | std::ios::binary);
+    trackFile.write(lines.data(), lines.size());
+}
 
-        return -1;
+// Function to start tracking several files/directories, writing .track only once
+// Returns -1 if any of the files didn't exist
+// repo -> the project
+// filePathsToAdd -> the paths of the files/directories to start tracking
+int addFilesToTrack(Repository& repo, const std::vector<std::string>& filePathsToAdd){
+    TRACE_SPAN("addFilesToTrack", TRACE_IO);
+    IgnoreRules ignoreRules = loadIgnoreRules(std::filesystem::current_path().string());
+    std::vector<std::string> newFiles;
+
+    int result = 0;
+
+    for(const std::string& filePathToAdd : filePathsToAdd){
+        if(addFileToTrack(filePathToAdd, ignoreRules, repo.trackedSet, newFiles) != 0){
+            result = -1;
+        }
     }
 
-    log(filePathToAdd + " added to tracking");
+    writeNewTrackedFiles(newFiles);
 
-    return 0;
+    repo.trackedFiles.insert(repo.trackedFiles.end(), newFiles.begin(), newFiles.end());
+
+    return result;
 }
 
-// Function to ignore a certain file/directory from the tracking
-// filePath -> path to file/directory to ignore
-void ignoreFileFromTracking(std::string filePath){
-    // If filePath is a directory, ignore all of the files inside of the directory
-    if(std::filesystem::is_directory(filePath)){
-        for(auto file : std::filesystem::recursive_directory_iterator(filePath)){
-            ignoreFileFromTracking(file.path().string());
+// Function for checking if a tracked file is one of the ignored paths or inside one of them
+// trackedFile -> the tracked file to check
+// ignoredPaths -> the files/directories being ignored
+bool isPathIgnored(const std::string& trackedFile, const std::unordered_set<std::string>& ignoredPaths){
+    if(ignoredPaths.count(trackedFile) > 0){
+        return true;
+    }
+
+    // Check every directory the file is in, from the deepest up
+    for(size_t splitPos = trackedFile.find_last_of('/'); splitPos != std::string::npos && splitPos > 0; splitPos = trackedFile.find_last_of('/', splitPos - 1)){
+        if(ignoredPaths.count(trackedFile.substr(0, splitPos)) > 0){
+            return true;
         }
     }
 
-    std::ifstream trackFile(".cupy/.track");
-    std::vector<std::string> trackedFiles;
+    return false;
+}
 
-    std::string line;
-    while(std::getline(trackFile, line)){
-        if(line != filePath){
-            trackedFiles.push_back(line);
+// Function to ignore files/directories from the tracking
+// Filters .track in one pass and replaces it in one go, so an interrupted ignore never leaves it half written
+// Directories don't need to still exist, any tracked file inside them is ignored
+// repo -> the project
+// filePaths -> paths to the files/directories to ignore
+void ignoreFilesFromTracking(Repository& repo, const std::vector<std::string>& filePaths){
+    TRACE_SPAN("ignoreFilesFromTracking", TRACE_IO);
+    std::unordered_set<std::string> ignoredPaths;
+
+    for(const std::string& filePath : filePaths){
+        // Trailing slashes would stop directories from matching
+        std::string ignoredPath = filePath;
+        while(ignoredPath.size() > 1 && ignoredPath.back() == '/'){
+            ignoredPath.pop_back();
         }
+
+        ignoredPaths.insert(ignoredPath);
     }
 
-    trackFile.close();
+    std::string lines;
+    std::vector<std::string> keptFiles;
 
-    std::ofstream trackFileOut(".cupy/.track");
-    
-    for(std::string trackedFile : trackedFiles){
-        trackFileOut << trackedFile << std::endl;
+    for(const std::string& trackedFile : repo.trackedFiles){
+        if(isPathIgnored(trackedFile, ignoredPaths)){
+            log(trackedFile + " ignored from tracking");
+        }else{
+            lines += trackedFile + "\n";
+            keptFiles.push_back(trackedFile);
+        }
     }
-    
+
+    size_t ignoredCount = repo.trackedFiles.size() - keptFiles.size();
+
+    if(ignoredCount == 0){
+        log("No tracked files to ignore");
+        return;
+    }
+
+    std::ofstream trackFileOut(".cupy/.track.tmp", std::ios::binary);
+    trackFileOut.write(lines.data(), lines.size());
     trackFileOut.close();
 
-    log(filePath + " ignored from tracking");
+    if(!trackFileOut){
+        error("Cannot write .cupy/.track.tmp, nothing ignored");
+        return;
+    }
+
+    std::filesystem::rename(".cupy/.track.tmp", ".cupy/.track");
+
+    repo.trackedFiles = keptFiles;
+    repo.trackedSet = std::unordered_set<std::string>(keptFiles.begin(), keptFiles.end());
 }
 
 // Function for rebuilding an old version of a file
+// repo -> the project
 // filePath -> path to the file to rebuild
 // saveIDFinal -> the save ID to rebuild up to (and including)
-std::string rebuildOldFile(std::string filePath, int saveIDFinal){
+std::string rebuildOldFile(const Repository& repo, const std::string& filePath, int saveIDFinal){
+    TRACE_SPAN("rebuildOldFile", TRACE_REBUILD, filePath);
+    if(isReverseStorage()){
+        // Start from the newest version and walk back, rather than replaying every save from the first
+        return rebuildFromHead(repo, filePath, saveIDFinal);
+    }
+
     if(saveIDFinal < 0){
         // Trying to rebuild when there isn't a previous save to rebuild from
         return "";
     }
 
-    std::vector<std::string> oldFileSplit;
-    std::vector<Change> changes;
+    // Lines of the file so far, copied out of each .changes into the table's arena as they're read
+    LineTable oldFileLines;
     bool foundContent = false;
 
-    // Sort so it applies changes in the correct order
-    std::vector<std::filesystem::__cxx11::directory_entry> directoryEntries;
+    // Content of the latest chunked entry, returned as-is if nothing has changed it since
+    std::string chunkedContent = "";
+    bool lastEntryChunked = false;
 
-    for(auto saveDir : std::filesystem::directory_iterator(".cupy/saves/")){
-        directoryEntries.push_back(saveDir);
-    }
+    refreshSaveFilters();
 
-    // Sort according to the filename of the path, which is the save ID (otherwise would be lexographically)
-    std::sort(directoryEntries.begin(), directoryEntries.end(), [](std::filesystem::__cxx11::directory_entry a, std::filesystem::__cxx11::directory_entry b){
-        return std::stoi(a.path().filename().string()) < std::stoi(b.path().filename().string());
-    });
+    // Built once, rather than for every line compared
+    std::string entryHeader = '[' + filePath;
 
-    // Iterate over the save directories in order
-    for(auto saveDir : directoryEntries){
+    // Iterate over the saves in order, so changes are applied in the correct order
+    for(int saveID : repo.saveIDs){
         // If we have gone past the saveIDFinal, break
-        if(saveDir.path().string() == ".cupy/saves/" + std::to_string(saveIDFinal + 1)){
+        if(saveID > saveIDFinal){
             break;
         }
 
-        std::string changesFilePath = saveDir.path().string() + "/.changes";
+        // Skip saves that certainly don't have an entry for the file
+        if(!saveMayTouch(saveID, filePath)){
+            continue;
+        }
+
+        std::string changesFilePath = ".cupy/saves/" + std::to_string(saveID) + "/.changes";
 
         if(doesFileExist(changesFilePath)){
-            std::ifstream changesFile(changesFilePath);
+            MappedFile changesFile(changesFilePath);
+            LineReader changesLines(changesFile.view());
+
+            std::string_view line;
+            while(changesLines.next(line)){
+                if(line == entryHeader){
+                    // Large and binary files are stored as a full list of chunks, which replaces everything before it
+                    LineReader entryLines = changesLines;
+                    entryLines.next(line);
+
+                    std::string_view markerLine;
+                    if(entryLines.next(markerLine) && markerLine == CHUNKED_ENTRY_MARKER){
+                        std::vector<std::string> chunkHashes;
+
+                        std::string_view chunkLine;
+                        while(entryLines.next(chunkLine) && chunkLine != "--------------------"){
+                            chunkHashes.push_back(std::string(chunkLine));
+                        }
+
+                        chunkedContent = loadChunks(".cupy/chunks", chunkHashes);
+                        lastEntryChunked = true;
+                        foundContent = true;
+
+                        oldFileLines.clear();
+
+                        break;
+                    }
+
+                    if(lastEntryChunked){
+                        // Line changes after a chunked entry are relative to the chunked content, which the lines point into
+                        oldFileLines = LineTable(chunkedContent);
+
+                        lastEntryChunked = false;
+                    }
 
-            std::string line;
-            while(std::getline(changesFile, line)){
-                if(line == '[' + filePath){
                     if(!foundContent){
                         // Ignore hash
-                        std::getline(changesFile, line);
+                        changesLines.next(line);
 
-                        std::string changesLine = "";
-                        while(std::getline(changesFile, changesLine) && changesLine != "--------------------"){
-                            int splitPos = changesLine.find_first_of(':');
+                        std::string_view changesLine;
+                        while(changesLines.next(changesLine) && changesLine != "--------------------"){
+                            size_t splitPos = changesLine.find_first_of(':');
 
                             // Store the content of the original save of the file
-                            oldFileSplit.push_back(changesLine.substr(splitPos+1));
+                            oldFileLines.push_back(changesLine.substr(splitPos+1));
                         }
 
                         foundContent = true;
@@ -267,15 +364,23 @@ std::string rebuildOldFile(std::string filePath, int saveIDFinal){
 
                     }else{
                         // Ignore hash
-                        std::getline(changesFile, line);
-
-                        std::string changesLine = "";
-                        while(std::getline(changesFile, changesLine) && changesLine != "--------------------" && changesLine != ""){
-                            int splitPos = changesLine.find_first_of(':');
-                            
-                            // Store the change represented by the changesLine
-                            Change change = {std::stoi(changesLine.substr(0, splitPos)), changesLine.substr(splitPos+1)};
-                            changes.push_back(change);
+                        changesLines.next(line);
+
+                        std::string_view changesLine;
+                        while(changesLines.next(changesLine) && changesLine != "--------------------" && changesLine != ""){
+                            size_t splitPos = changesLine.find_first_of(':');
+                            int lineNum = parseLineNumber(changesLine);
+
+                            if(lineNum < 1){
+                                continue;
+                            }
+
+                            // Apply the change represented by the changesLine, in save order
+                            if(lineNum > static_cast<int>(oldFileLines.size())){
+                                oldFileLines.resize(lineNum);
+                            }
+
+                            oldFileLines.set(lineNum-1, changesLine.substr(splitPos+1));
                         }
                     }
                 }
@@ -283,148 +388,122 @@ std::string rebuildOldFile(std::string filePath, int saveIDFinal){
         }
     }
 
-    // Apply the changes
-    for(Change change : changes){
-        if(change.lineNum > oldFileSplit.size()){
-            oldFileSplit.resize(change.lineNum);
-        }
-
-        oldFileSplit[change.lineNum-1] = change.lineContent;
+    if(lastEntryChunked){
+        return chunkedContent;
     }
 
-    std::string oldFileUpdated = reconstructSplitString(oldFileSplit);
+    std::string oldFileUpdated = reconstructSplitString(oldFileLines);
 
     return oldFileUpdated;
 }
 
-// Function for checking if a file has changed from previous save
-// filePath -> path to file that is being checked
-bool hasFileChanged(std::string filePath){
-    std::string oldHash = "";
-    std::string newHash = "";
+// Function for checking if a certain file has a beginning save entry
+// repo -> the project
+// filePath -> path to file that's being checked
+bool hasNoFullEntry(const Repository& repo, const std::string& filePath){
+    TRACE_SPAN("hasNoFullEntry", TRACE_IO, filePath);
+    if(isReverseStorage()){
+        std::string hash;
+        return !readHeadHash(filePath, hash);
+    }
 
-    // Sort directories first to keep oldHash finding updated to the most recent hash
-    std::vector<std::filesystem::__cxx11::directory_entry> directoryEntries;
+    refreshSaveFilters();
 
-    for(auto saveDir : std::filesystem::directory_iterator(".cupy/saves/")){
-        directoryEntries.push_back(saveDir);
-    }
+    std::string entryHeader = '[' + filePath;
 
-    // Sort according to the filename of the path, which is the save ID (otherwise would be lexographically)
-    std::sort(directoryEntries.begin(), directoryEntries.end(), [](std::filesystem::__cxx11::directory_entry a, std::filesystem::__cxx11::directory_entry b){
-        return std::stoi(a.path().filename().string()) < std::stoi(b.path().filename().string());
-    });
+    for(int saveID : repo.saveIDs){
+        // Skip saves that certainly don't have an entry for the file
+        if(!saveMayTouch(saveID, filePath)){
+            continue;
+        }
 
-    // Iterate over all change files in order
-    for(auto saveDir : directoryEntries){
-        std::string changesFilePath = saveDir.path().string() + "/.changes";
+        std::string changesFilePath = ".cupy/saves/" + std::to_string(saveID) + "/.changes";
 
         if(doesFileExist(changesFilePath)){
-            std::ifstream changesFile(changesFilePath);
-
-            // Get the most updated hash
-            std::string line;
-            while(std::getline(changesFile, line)){
-                if(line == '[' + filePath){
-                    std::getline(changesFile, oldHash);
-                    break;                
+            MappedFile changesFile(changesFilePath);
+            LineReader changesLines(changesFile.view());
+
+            std::string_view line;
+            while(changesLines.next(line)){
+                if(line == entryHeader){
+                    return false;
                 }
             }
-
-            changesFile.close();
         }
     }
 
-    // Read file
-    std::ifstream file(filePath);
-
-    std::string content;
-    std::string line;
-    while(std::getline(file, line)){
-        content += line + "\n";
-    }
-
-    file.close();
-
-    if(content != ""){
-        content.pop_back();
-    }
-
-    if(content == ""){
-        // Hash of an empty string
-        newHash = "d41d8cd98f00b204e9800998ecf8427e";
-    }else{
-        // Calculate new hash
-        newHash = md5(content);
-    }
+    return true;
+}
 
-    if(oldHash != newHash && oldHash != ""){
-        return true;
-    }
+// Function for getting the tracked files that need checking for changes
+// If a watcher (cvcs watch) is running only the files it has seen change need checking, otherwise all of them do
+// trackedFiles -> all of the tracked files
+std::vector<std::string> getFilesToCheck(const std::vector<std::string>& trackedFiles){
+    std::vector<std::string> changedFiles;
 
-    if(oldHash == "" && newHash != ""){
-        return true;
+    if(!queryWatcher(changedFiles)){
+        return trackedFiles;
     }
 
-    return false;
-}
-
-// Function for checking if a certain file has a beginning save entry
-// filePath -> path to file that's being checked
-bool hasNoFullEntry(std::string filePath){
-    for(auto saveDir : std::filesystem::directory_iterator(".cupy/saves/")){
-        std::string changesFilePath = saveDir.path().string() + "/.changes";
+    std::set<std::string> changedSet(changedFiles.begin(), changedFiles.end());
 
-        if(doesFileExist(changesFilePath)){
-            std::ifstream changesFile(changesFilePath);
-
-            std::string line;
-            while(std::getline(changesFile, line)){
-                if(line == '[' + filePath){
-                    return false;
-                }
-            }
+    // Keep the tracked order, and leave out anything that stopped being tracked
+    std::vector<std::string> filesToCheck;
+    for(const std::string& trackedFile : trackedFiles){
+        if(changedSet.count(trackedFile) > 0){
+            filesToCheck.push_back(trackedFile);
         }
     }
 
-    return true;
+    return filesToCheck;
 }
 
 // Function to rollback to previous save
+// repo -> the project
 // saveID -> the ID of the save to rollback to
-void rollbackToSave(int saveID){
-    std::ifstream changesFile(".cupy/saves/" + std::to_string(saveID) + "/.changes");
+void rollbackToSave(Repository& repo, int saveID){
+    TRACE_SPAN("rollbackToSave", TRACE_COMMAND);
 
     // Get all files that have been made up to this point (at the time of the saveID save)
     std::set<std::string> filePaths;
     for(int currentSaveID=0;currentSaveID<=saveID;currentSaveID++){
-        std::ifstream changeFile(".cupy/saves/" + std::to_string(currentSaveID) + "/.changes");
+        MappedFile changeFile(".cupy/saves/" + std::to_string(currentSaveID) + "/.changes");
+        LineReader changeLines(changeFile.view());
         
-        std::string line;
-        while(std::getline(changeFile, line)){
-            if(line[0] != '['){
+        std::string_view line;
+        while(changeLines.next(line)){
+            if(line.empty() || line[0] != '['){
                 continue;
             }
 
-            filePaths.insert(line.substr(1));
+            filePaths.insert(std::string(line.substr(1)));
         }
     }
 
     // Rebuild each file and write to the files their previous content (at the time of the saveID save)
     for(std::string path : filePaths){
-        std::string newContent = rebuildOldFile(path, saveID);
+        std::string newContent = rebuildOldFile(repo, path, saveID);
 
-        std::ofstream outFile(path);
+        std::ofstream outFile(path, std::ios::binary);
 
         outFile << newContent;
 
         outFile.close();
+
+        // Anything read of the file before is out of date now
+        forgetFile(repo, path);
     }
 }
 
 // Function for OBLITERATING a save
+// repo -> the project
 // saveID -> ID of the save to obliterate
-void obliterateSave(int saveID){
+void obliterateSave(Repository& repo, int saveID){
+    if(isReverseStorage()){
+        // The newest versions come from the saves about to be removed, so move them back first
+        rewindHeads(repo, saveID - 1);
+    }
+
     for(auto saveDir : std::filesystem::directory_iterator(".cupy/saves/")){
         int currentSaveID = std::stoi(saveDir.path().filename().string());
 
@@ -434,11 +513,15 @@ void obliterateSave(int saveID){
             std::filesystem::remove_all(saveDir.path());
         }
     }
+
+    repo.saveIDs.erase(std::lower_bound(repo.saveIDs.begin(), repo.saveIDs.end(), saveID), repo.saveIDs.end());
 }
 
 // Function for viewing changes made in a certain save
+// repo -> the project
 // saveID -> ID of the save to view changes from
-void viewChanges(int saveID){
+void viewChanges(const Repository& repo, int saveID){
+    TRACE_SPAN("viewChanges", TRACE_COMMAND);
     log("Viewing change " + std::to_string(saveID));
     std::ifstream changesFile(".cupy/saves/" + std::to_string(saveID) + "/.changes");
 
@@ -460,20 +543,25 @@ void viewChanges(int saveID){
             std::string filePath = line.substr(1);
 
             // Get the content before the save and then after the save
-            std::string oldFileContent = rebuildOldFile(filePath, saveID-1);
-            std::string updatedFileContent = rebuildOldFile(filePath, saveID);
+            std::string oldFileContent = rebuildOldFile(repo, filePath, saveID-1);
+            std::string updatedFileContent = rebuildOldFile(repo, filePath, saveID);
+
+            if(isChunkedContent(oldFileContent) || isChunkedContent(updatedFileContent)){
+                log("Changes for file: " + filePath + " (large or binary file, line changes not shown)");
+                continue;
+            }
 
-            std::vector<std::string> changes = getChanges(oldFileContent, updatedFileContent);
+            LineTable changes = getChanges(oldFileContent, updatedFileContent);
 
             if(changes.size() > 0){
                 log("Changes for file: " + filePath);
             }
 
-            for(std::string change : changes){
-                int splitPos = change.find(':');
+            for(std::string_view change : changes){
+                size_t splitPos = change.find(':');
 
-                int lineNum = std::stoi(change.substr(0, splitPos));
-                std::string changeContent = change.substr(splitPos+1);
+                int lineNum = parseLineNumber(change);
+                std::string changeContent(change.substr(splitPos+1));
 
                 log("Line " + std::to_string(lineNum) + " => " + changeContent);
             }
@@ -495,110 +583,294 @@ bool isInitialised(){
     return false;
 }
 
+// Struct for storing a piece of a file being uploaded
+struct UploadChunk{
+    size_t fileIndex;
+    size_t offset;
+    size_t length;
+    std::string hash;
+};
+
+// Function for sending a set of chunks over their own connection
+// repo -> the project, holding the content of every file in the batch
+// projectName -> name of the project being uploaded
+// sessionID -> ID of the upload session (given by the server)
+// filePaths -> all file paths in the batch
+// chunks -> the chunks this connection is responsible for, grouped by file
+int uploadChunks(const Repository& repo, std::string projectName, std::string sessionID, const std::vector<std::string>& filePaths, std::vector<UploadChunk> chunks){
+    TRACE_SPAN("uploadChunks", TRACE_NET);
+    SocketType chunkSocket = openSession(SERVER_IP, SERVER_PORT);
+
+    int requestID = sendRequest(chunkSocket, "uploadchunks");
+    sendMessage(chunkSocket, projectName);
+    sendMessage(chunkSocket, sessionID);
+    sendMessage(chunkSocket, std::to_string(chunks.size()));
+
+    // The files were read while they were chunked, and every stream shares that one copy
+    size_t currentFileIndex = filePaths.size();
+    const std::string* content = nullptr;
+
+    for(const UploadChunk& chunk : chunks){
+        if(chunk.fileIndex != currentFileIndex){
+            currentFileIndex = chunk.fileIndex;
+            content = &repo.fileContents.at(filePaths[currentFileIndex]);
+
+            log("Uploading " + filePaths[currentFileIndex]);
+        }
+
+        sendMessage(chunkSocket, chunk.hash);
+        sendMessage(chunkSocket, std::string_view(*content).substr(chunk.offset, chunk.length));
+    }
+
+    SessionReply reply = receiveReply(chunkSocket, requestID);
+
+    closeSession(chunkSocket);
+
+    return (reply.ok && reply.messages[0] == "ok") ? 0 : -1;
+}
+
 // Function for uploading files to the server
-int upload(int clientSocket, std::string projectName, std::vector<std::string> filePaths, std::string saveMessage){
-    sendMessage(clientSocket, "upload");
+// Files are split into content-defined chunks and only the chunks the server doesn't already have staged are sent,
+// spread across up to UPLOAD_STREAMS connections. The session ID is kept in .cupy/.upload until the server commits
+// the save, so running the same upload again after a dropped connection only sends what's missing
+// repo -> the project
+// clientSocket -> session used to start and commit the upload
+// projectName -> name of the project being uploaded
+// filePaths -> paths of the files to upload
+// saveMessage -> message attached to the save
+int upload(Repository& repo, int clientSocket, std::string projectName, std::vector<std::string> filePaths, std::string saveMessage){
+    TRACE_SPAN("upload", TRACE_COMMAND);
+    // Chunk every file and build the manifest (file count, then path, chunk count and chunk hashes for each file)
+    std::vector<UploadChunk> allChunks;
+    std::string manifest = std::to_string(filePaths.size()) + "\n";
+
+    // Files are read, chunked and added to the manifest in a pipeline, so reading the next files overlaps hashing this one
+    auto chunkFile = [](PipelineFile& file){
+        file.chunks = chunkContent(file.content);
+
+        for(ChunkSpan span : file.chunks){
+            file.chunkHashes.push_back(md5(std::string_view(file.content).substr(span.offset, span.length)));
+        }
+    };
+
+    auto addToManifest = [&](PipelineFile& file){
+        manifest += file.path + "\n" + std::to_string(file.chunks.size()) + "\n";
+
+        for(size_t i=0; i<file.chunks.size(); i++){
+            UploadChunk chunk = {file.index, file.chunks[i].offset, file.chunks[i].length, file.chunkHashes[i]};
+
+            manifest += chunk.hash + "\n";
+            allChunks.push_back(chunk);
+        }
+
+        // Kept for sending the chunks the server is missing
+        addFileContent(repo, file.path, std::move(file.content));
+    };
+
+    runFilePipeline(filePaths, chunkFile, addToManifest);
+
+    // Pick up the session from an earlier attempt, if there was one
+    std::string sessionID;
+    std::ifstream uploadFile(".cupy/.upload");
+    std::getline(uploadFile, sessionID);
+    uploadFile.close();
+
+    int beginRequestID = sendRequest(clientSocket, "uploadbegin");
     sendMessage(clientSocket, projectName);
-    sendMessage(clientSocket, std::to_string(filePaths.size()));
+    sendMessage(clientSocket, sessionID);
     sendMessage(clientSocket, saveMessage);
+    sendMessage(clientSocket, manifest);
 
-    log("Uploading files from projectName");
+    SessionReply beginReply = receiveReply(clientSocket, beginRequestID);
 
-    for(std::string filePath : filePaths){
-        log("Uploading " + filePath);
+    if(!beginReply.ok || beginReply.messages[0] == ""){
+        error("Server refused the upload");
+        return -1;
+    }
 
-        sendMessage(clientSocket, filePath);
+    std::string newSessionID = beginReply.messages[0];
+    std::string missingList = beginReply.messages[1];
 
-        // Read file
-        std::string content;
-        std::ifstream file(filePath);
-        
-        std::string line;
-        while(std::getline(file, line)){
-            content += line + '\n';
+    if(newSessionID == sessionID){
+        log("Resuming upload session " + sessionID);
+    }
+
+    std::ofstream uploadFileOut(".cupy/.upload");
+    uploadFileOut << newSessionID << std::endl;
+    uploadFileOut.close();
+
+    // Only send each missing chunk once, even if it appears in several files
+    std::set<std::string> missing;
+    std::istringstream missingStream(missingList);
+
+    std::string chunkHash;
+    while(std::getline(missingStream, chunkHash)){
+        missing.insert(chunkHash);
+    }
+
+    std::vector<UploadChunk> toSend;
+    for(const UploadChunk& chunk : allChunks){
+        if(missing.erase(chunk.hash) > 0){
+            toSend.push_back(chunk);
+        }
+    }
+
+    log(std::to_string(toSend.size()) + " of " + std::to_string(allChunks.size()) + " chunk(s) need uploading");
+
+    // Spread the chunks over the streams, keeping each file's chunks on one stream where possible
+    size_t streamCount = std::max<size_t>(1, std::min<size_t>(UPLOAD_STREAMS, toSend.size()));
+
+    std::vector<std::vector<UploadChunk>> streamChunks(streamCount);
+    std::vector<size_t> streamLoad(streamCount, 0);
+
+    for(const UploadChunk& chunk : toSend){
+        size_t stream = std::min_element(streamLoad.begin(), streamLoad.end()) - streamLoad.begin();
+
+        if(!streamChunks[stream].empty() && streamChunks[stream].back().fileIndex != chunk.fileIndex){
+            // Prefer the stream already holding this file, unless it's much more loaded
+            for(size_t j=0; j<streamCount; j++){
+                if(!streamChunks[j].empty() && streamChunks[j].back().fileIndex == chunk.fileIndex && streamLoad[j] < streamLoad[stream] + CHUNK_MAX_SIZE){
+                    stream = j;
+                    break;
+                }
+            }
+        }
+
+        streamChunks[stream].push_back(chunk);
+        streamLoad[stream] += chunk.length;
+    }
+
+    std::vector<std::future<int>> streams;
+    for(size_t i=0; i<streamCount; i++){
+        if(!streamChunks[i].empty()){
+            streams.push_back(std::async(std::launch::async, uploadChunks, std::cref(repo), projectName, newSessionID, std::cref(filePaths), streamChunks[i]));
+        }
+    }
+
+    int retCode = 0;
+    for(std::future<int>& stream : streams){
+        try{
+            if(stream.get() != 0){
+                retCode = -1;
+            }
+        }catch(std::exception& err){
+            error(std::string("Upload connection failed: ") + err.what());
+            retCode = -1;
         }
-        content.pop_back();
+    }
+
+    if(retCode != 0){
+        error("Upload interrupted, run the same upload again to resume it");
+        return -1;
+    }
+
+    int commitRequestID = sendRequest(clientSocket, "uploadcommit");
+    sendMessage(clientSocket, projectName);
+    sendMessage(clientSocket, newSessionID);
+
+    SessionReply commitReply = receiveReply(clientSocket, commitRequestID);
 
-        file.close();
+    int saveID = commitReply.ok ? std::stoi(commitReply.messages[0]) : -1;
 
-        // Send over file contents
-        sendMessage(clientSocket, content);
+    if(saveID < 0){
+        error("Server is missing chunks, run the same upload again to resume it");
+        return -1;
     }
 
+    // The session has been committed, so the next upload starts a fresh one
+    std::filesystem::remove(".cupy/.upload");
+
+    log("Uploaded as save " + std::to_string(saveID));
+
     return 0;
 }
 
 // Function for getting all project names from the server
 std::vector<std::string> getProjectNames(){
+    TRACE_SPAN("getProjectNames", TRACE_NET);
     // Ask server for list of project names
 
     initialiseSockets();
 
-    SocketType clientSocket = connectToServer(SERVER_IP, SERVER_PORT);
+    SocketType clientSocket = openSession(SERVER_IP, SERVER_PORT);
 
     log("Requesting project names...");
 
-    sendMessage(clientSocket, "list");
-    
-    int projectCount = std::stoi(receiveMessage(clientSocket));
+    int requestID = sendRequest(clientSocket, "list");
 
-    if(projectCount < 0){
-        return {};
-    }
+    SessionReply reply = receiveReply(clientSocket, requestID);
+
+    closeSession(clientSocket);
 
-    std::vector<std::string> projectNames;
-    for(int i=0; i<projectCount; i++){
-        std::string projectName = receiveMessage(clientSocket);
-        projectNames.push_back(projectName);
+    if(!reply.ok || std::stoi(reply.messages[0]) < 0){
+        return {};
     }
 
-    closeSocket(clientSocket);
+    // First message is the count, the rest are the names
+    std::vector<std::string> projectNames(reply.messages.begin() + 1, reply.messages.end());
 
     return projectNames;
 }
 
+// Function for getting the server's metrics (counters and latency histograms) as JSON
+std::string getServerStats(){
+    initialiseSockets();
+
+    SocketType clientSocket = openSession(SERVER_IP, SERVER_PORT);
+
+    int requestID = sendRequest(clientSocket, "stats");
+
+    SessionReply reply = receiveReply(clientSocket, requestID);
+
+    closeSession(clientSocket);
+
+    if(!reply.ok || reply.messages.empty()){
+        return "";
+    }
+
+    return reply.messages[0];
+}
+
 // Function for downloading a certain project
 int download(std::string projectName){
+    TRACE_SPAN("download", TRACE_NET, projectName);
     initialiseSockets();
 
-    SocketType clientSocket = connectToServer(SERVER_IP, SERVER_PORT);
+    SocketType clientSocket = openSession(SERVER_IP, SERVER_PORT);
 
     log("Downloading project " + projectName);
 
-    sendMessage(clientSocket, "download");
+    int requestID = sendRequest(clientSocket, "download");
     sendMessage(clientSocket, projectName);
 
-    closeSocket(clientSocket);
-}
-
-std::string getProjectName(){
-    std::ifstream projectFile(".cupy/.project");
-
-    std::string projectName;
-    std::getline(projectFile, projectName);
+    receiveReply(clientSocket, requestID);
 
-    projectFile.close();
+    closeSession(clientSocket);
 
-    return projectName;
+    return 0;
 }
 
 int main(int argc, char* argv[]){
-    std::string projectName = "";
+    // "--trace <file>" can go anywhere on the command line, it's taken out before the command is parsed
+    startTracingFromArguments(argc, argv);
 
-    if(isInitialised()){
-        std::ifstream projectFile(std::filesystem::current_path().string() + "/.cupy/project");
+    TRACE_SPAN("cvcs", TRACE_COMMAND, argc > 1 ? std::string(argv[1]) : std::string(""));
 
-        std::getline(projectFile, projectName);
-    
-        projectFile.close();
+    // Everything the command needs from the project is loaded once here, and working files are read through it
+    Repository repo;
+
+    if(isInitialised()){
+        repo = openRepository();
     }
 
+    std::string projectName = repo.projectName;
+
     if(argc <= 1){
-        error("Not enough arguments passed. Usage:\ncvcs init <directory>\ncvcs save <message>?\ncvcs add <filename>\ncvcs ignore <filename>\ncvcs rollback <saveID>\ncvcs obliterate <saveID>\ncvcs history\ncvcs status\ncvcs upload <filenames>? @<message>@?\ncvcs download <projectname?>");
+        error("Not enough arguments passed. Usage:\ncvcs init <directory> --reverse-deltas?\ncvcs save <message>?\ncvcs add <filename>\ncvcs ignore <filename>\ncvcs rollback <saveID>\ncvcs obliterate <saveID>\ncvcs history\ncvcs status\ncvcs watch\ncvcs upload <filenames>? @<message>@?\ncvcs download <projectname?>\ncvcs stats\nAdd --trace <file> to any command to record a trace of it");
         return -1;
 
     }else if(std::string(argv[1]) == "help"){
-        log("Usage:\ncvcs init <directory>\ncvcs save <message>?\ncvcs add <filename>\ncvcs ignore <filename>\ncvcs rollback <saveID>\ncvcs obliterate <saveID>\ncvcs history\ncvcs status\ncvcs upload <filenames>? @<message>@?\ncvcs download <projectname?>");
+        log("Usage:\ncvcs init <directory> --reverse-deltas?\ncvcs save <message>?\ncvcs add <filename>\ncvcs ignore <filename>\ncvcs rollback <saveID>\ncvcs obliterate <saveID>\ncvcs history\ncvcs status\ncvcs watch\ncvcs upload <filenames>? @<message>@?\ncvcs download <projectname?>\ncvcs stats\nAdd --trace <file> to any command to record a trace of it");
 
     }else if(std::string(argv[1]) == "history" && argc == 2){
         // View history
@@ -608,17 +880,8 @@ int main(int argc, char* argv[]){
             return -11;
         }
 
-        // Sort because who would want to see the history out of order
-        std::vector<std::filesystem::__cxx11::directory_entry> directoryEntries;
-
-        for(auto saveDir : std::filesystem::directory_iterator(".cupy/saves/")){
-            directoryEntries.push_back(saveDir);
-        }
-
-        // Sort according to the filename of the path, which is the save ID (otherwise would be lexographically)
-        std::sort(directoryEntries.begin(), directoryEntries.end(), [](std::filesystem::__cxx11::directory_entry a, std::filesystem::__cxx11::directory_entry b){
-            return std::stoi(a.path().filename().string()) < std::stoi(b.path().filename().string());
-        });
+        // Copied, as obliterating a save takes it (and every save after it) out of the project's list
+        std::vector<int> saveIDs = repo.saveIDs;
 
         log("Available commands: ");
         log("  q: Quit");
@@ -628,22 +891,16 @@ int main(int argc, char* argv[]){
 
         // Iterate over save directories in order
         std::string input;
-        for(auto saveDir : directoryEntries){
-            std::string saveFilePath = saveDir.path().string() + "/.save";
+        for(int saveID : saveIDs){
+            std::string saveFilePath = ".cupy/saves/" + std::to_string(saveID) + "/.save";
             std::ifstream saveFile(saveFilePath);
-            std::string changesFilePath = saveDir.path().string() + "/.changes";
-            std::ifstream changesFile(changesFilePath);
 
             std::string dateTime = "";
             std::string message = "";
-            
-            int saveID = 0;
 
             std::getline(saveFile, dateTime);
             std::getline(saveFile, message);
 
-            saveID = std::stoi(saveDir.path().filename().string());
-
             saveFile.close();
 
             log("------------------------");
@@ -658,11 +915,11 @@ int main(int argc, char* argv[]){
                 if(input == "q"){
                     break;
                 }else if(input == "r"){
-                    rollbackToSave(saveID);
+                    rollbackToSave(repo, saveID);
                 }else if(input == "o"){
-                    obliterateSave(saveID);
+                    obliterateSave(repo, saveID);
                 }else if(input == "v"){
-                    viewChanges(saveID);
+                    viewChanges(repo, saveID);
                 }else if(input == ""){
                     break;
                 }
@@ -686,22 +943,26 @@ int main(int argc, char* argv[]){
     
         std::string fileToAdd = std::string(argv[2]);
 
-        addFileToTrack(std::filesystem::current_path().string() + "/" + fileToAdd);
+        addFilesToTrack(repo, {std::filesystem::current_path().string() + "/" + fileToAdd});
 
         return 0;
 
     }else if(std::string(argv[1]) == "add" && argc > 3){
-        // Iterate over argv and pass each file to addFileToTrack
+        // Collect every file in argv and add them all to tracking at once
 
         if(!isInitialised()){
             error("cvcs not initialised!");
             return -11;
         }
 
+        std::vector<std::string> filesToAdd;
+
         for(int i = 2; i < argc; i++){
-            addFileToTrack(std::filesystem::current_path().string() + "/" + std::string(argv[i]));
+            filesToAdd.push_back(std::filesystem::current_path().string() + "/" + std::string(argv[i]));
         }
 
+        addFilesToTrack(repo, filesToAdd);
+
         return 0;
 
     }else if(std::string(argv[1]) == "ignore" && argc == 3){
@@ -713,22 +974,26 @@ int main(int argc, char* argv[]){
         }
 
         std::string fileToIgnore = std::string(argv[2]);
-        ignoreFileFromTracking(std::filesystem::current_path().string() + "/" + fileToIgnore);
+        ignoreFilesFromTracking(repo, {std::filesystem::current_path().string() + "/" + fileToIgnore});
 
         return 0;
 
     }else if(std::string(argv[1]) == "ignore" && argc > 3){
-        // Iterate over argv and pass each file to ignoreFileFromTracking
+        // Collect every file in argv and ignore them all at once
 
         if(!isInitialised()){
             error("cvcs not initialised!");
             return -11;
         }
 
+        std::vector<std::string> filesToIgnore;
+
         for(int i=2; i<argc; i++){
-            ignoreFileFromTracking(std::filesystem::current_path().string() + "/" + std::string(argv[i]));
+            filesToIgnore.push_back(std::filesystem::current_path().string() + "/" + std::string(argv[i]));
         }
 
+        ignoreFilesFromTracking(repo, filesToIgnore);
+
         return 0;
 
     }else if(std::string(argv[1]) == "rollback" && argc == 3){
@@ -741,14 +1006,14 @@ int main(int argc, char* argv[]){
 
         int saveID = std::stoi(argv[2]);
 
-        if(saveID > getLastSaveID()){
+        if(saveID > getLastSaveID(repo)){
             error("Invalid save ID");
             return -9;
         }
 
         log("Rolling back to save " + std::to_string(saveID));
 
-        rollbackToSave(saveID);
+        rollbackToSave(repo, saveID);
 
         return 0;
     
@@ -760,19 +1025,14 @@ int main(int argc, char* argv[]){
             return -11;
         }
 
-        std::string projectName = getProjectName();
-
         initialiseSockets();
 
-        SocketType clientSocket = connectToServer(SERVER_IP, SERVER_PORT);
+        SocketType clientSocket = openSession(SERVER_IP, SERVER_PORT);
 
-        // Iterate over tracked files and pass each file to upload function
-        
-        std::vector<std::string> trackedFiles = getTrackedFiles();
-
-        upload(clientSocket, projectName, trackedFiles, "");
+        // Pass every tracked file to upload function
+        upload(repo, clientSocket, projectName, repo.trackedFiles, "");
 
-        closeSocket(clientSocket);
+        closeSession(clientSocket);
 
     }else if(std::string(argv[1]) == "upload" && argc == 3){
         // Either "cvcs upload <filename>" or "cvcs upload <message>" has been ran
@@ -784,29 +1044,25 @@ int main(int argc, char* argv[]){
 
         std::string argument = std::string(argv[2]);
 
-        std::string projectName = getProjectName();
-
         initialiseSockets();
 
-        SocketType clientSocket = connectToServer(SERVER_IP, SERVER_PORT);
+        SocketType clientSocket = openSession(SERVER_IP, SERVER_PORT);
 
         if(argument[0] == '@' && argument[argument.length()-1] == '@'){
             // It's a string, so must be the message
 
             argument = argument.substr(1).substr(0, argument.length()-2);
 
-            std::vector<std::string> trackedFiles = getTrackedFiles();
-
-            upload(clientSocket, projectName, trackedFiles, argument);
+            upload(repo, clientSocket, projectName, repo.trackedFiles, argument);
 
         }else{
             // Must be the file name
             std::vector<std::string> files = {argument};
 
-            upload(clientSocket, projectName, files, "No message provided");
+            upload(repo, clientSocket, projectName, files, "No message provided");
         }
 
-        closeSocket(clientSocket);
+        closeSession(clientSocket);
 
     }else if(std::string(argv[1]) == "upload" && argc > 3){
         // Upload specified files onto server (server does diff processing)
@@ -816,11 +1072,9 @@ int main(int argc, char* argv[]){
             return -11;
         }
 
-        std::string projectName = getProjectName();
-
         initialiseSockets();
 
-        SocketType clientSocket = connectToServer(SERVER_IP, SERVER_PORT);
+        SocketType clientSocket = openSession(SERVER_IP, SERVER_PORT);
 
         // Iterate over argv and pass each file to upload function
 
@@ -839,14 +1093,14 @@ int main(int argc, char* argv[]){
             // Remove the message from the files
             files.pop_back();
 
-            upload(clientSocket, projectName, files, message);
+            upload(repo, clientSocket, projectName, files, message);
         }else{
             // User did not include a message
 
-            upload(clientSocket, projectName, files, "No message provided");
+            upload(repo, clientSocket, projectName, files, "No message provided");
         }
 
-        closeSocket(clientSocket);
+        closeSession(clientSocket);
 
     }else if(std::string(argv[1]) == "download" && argc == 2){
         // Get project names and let user choose which one to download
@@ -866,6 +1120,49 @@ int main(int argc, char* argv[]){
 
         error("Not yet implemented!!");
 
+    }else if(std::string(argv[1]) == "watch" && argc == 2){
+        // Keep track of changed files in the background, so status and save only check those
+
+        if(!isInitialised()){
+            error("cvcs not initialised!");
+            return -11;
+        }
+
+        // The watcher runs for a long time, so its log lines shouldn't sit in stdout's buffer
+        startLogWriter();
+
+        // Each rescan is a fresh look at the project, started when the watcher asks for the tracked files
+        Repository watchedRepo;
+
+        TrackedFilesGetter getTrackedFiles = [&watchedRepo](){
+            watchedRepo = openRepository();
+
+            return watchedRepo.trackedFiles;
+        };
+
+        FileChangeCheck checkFile = [&watchedRepo](std::string filePath){
+            bool changed = hasFileChanged(watchedRepo, filePath);
+
+            // The watcher only needs to know, not the content
+            releaseFileContent(watchedRepo, filePath);
+
+            return changed;
+        };
+
+        return runWatcher(getTrackedFiles, checkFile);
+
+    }else if(std::string(argv[1]) == "stats" && argc == 2){
+        // Print the server's metrics
+
+        std::string stats = getServerStats();
+
+        if(stats == ""){
+            error("Server did not return any stats");
+            return -1;
+        }
+
+        std::cout << stats;
+
     }else if(std::string(argv[1]) == "status"){
         // Show status of tracked files
 
@@ -874,44 +1171,45 @@ int main(int argc, char* argv[]){
             return -11;
         }
 
-        std::vector<std::string> trackedFiles = getTrackedFiles();
+        std::vector<std::string> trackedFiles = getFilesToCheck(repo.trackedFiles);
 
         bool anyChanges = false;
         for(std::string trackedFile : trackedFiles){
-            if(hasFileChanged(trackedFile)){
+            if(hasFileChanged(repo, trackedFile)){
                 anyChanges = true;
 
                 log(trackedFile + " has been modified");
             
                 // Get the content at last save
-                std::string oldContent = rebuildOldFile(trackedFile, getLastSaveID());
-                
-                // Get the current content
-                std::string newContent = "";
-                std::ifstream newFileStream(trackedFile);
+                std::string oldContent = rebuildOldFile(repo, trackedFile, getLastSaveID(repo));
                 
-                std::string line;
-                while(std::getline(newFileStream, line)){
-                    newContent += line + "\n";
-                }
-                // Remove extra newline
-                newContent.pop_back();
+                // Get the current content, kept from checking it
+                const std::string& newContent = getFileContent(repo, trackedFile);
+
+                if(isChunkedContent(oldContent) || isChunkedContent(newContent)){
+                    log("[" + trackedFile + "] large or binary file, line changes not shown");
+                    log(" ");
 
-                newFileStream.close();
+                    releaseFileContent(repo, trackedFile);
 
-                std::vector<std::string> changes = getChanges(oldContent, newContent);
+                    continue;
+                }
 
-                for(std::string change : changes){
-                    int counter = change.find_first_of(':');
+                LineTable changes = getChanges(oldContent, newContent);
 
-                    int lineNum = std::stoi(change.substr(0, counter+1));
+                for(std::string_view change : changes){
+                    size_t counter = change.find_first_of(':');
 
-                    std::string newLine = change.substr(counter+1);
+                    int lineNum = parseLineNumber(change);
+
+                    std::string newLine(change.substr(counter+1));
 
                     log("[" + trackedFile + "]" + std::to_string(lineNum) + " => " + newLine);
                 }
 
                 log(" ");
+
+                releaseFileContent(repo, trackedFile);
             }
         }
 
@@ -933,7 +1231,7 @@ int main(int argc, char* argv[]){
 
         log("Obliterating save(s) " + std::to_string(saveID) + " onwards");
 
-        obliterateSave(saveID);
+        obliterateSave(repo, saveID);
 
     }else if((std::string(argv[1]) == "save") && (argc == 2 || argc == 3)){
         // Save the current state
@@ -943,111 +1241,168 @@ int main(int argc, char* argv[]){
             return -11;
         }
 
-        if(getLastSaveID() > 0){
-            // Check if any changes to files have been made
-            std::vector<std::string> trackedFiles = getTrackedFiles();
+        // Files the watcher hasn't seen change are the same as in the last save, and have been saved before
+        std::vector<std::string> filesToCheck = getFilesToCheck(repo.trackedFiles);
 
-            bool changesMade = false;
-            for(std::string trackedFile : trackedFiles){
-                if(hasFileChanged(trackedFile)){
-                    changesMade = true;
-                    break;
-                }
-            }
+        std::string cwd = std::filesystem::current_path().string();
 
-            // If they haven't, exit early
-            if(!changesMade){
-                error("No changes detected");
-                return -10;
-            }
-        }
+        std::string saveMessage = (argc == 2) ? "No message provided" : argv[2];
+        int saveID = getLastSaveID(repo) + 1;
+        std::string saveDirPath = cwd + "/.cupy/saves/" + std::to_string(saveID);
 
-        // Save current state
-        std::string cwd = std::filesystem::current_path().string();
+        // Paths this save has entries for, for its filter
+        std::vector<std::string> savedPaths;
 
-        for(auto file : std::filesystem::directory_iterator(cwd)){
-            std::filesystem::path path = file.path();
-            std::string fileName = path.filename().string();
+        std::ofstream changesFile;
+
+        // The save is only made once a file needs saving, so nothing is written if nothing has changed
+        auto startSave = [&](){
+            if(changesFile.is_open()){
+                return;
+            }
 
-            std::string saveMessage = (argc == 2) ? "No message provided" : argv[2];
-            int saveID = getLastSaveID() + 1;
+            // Saves made before filters existed get one now, while none of them are being written
+            writeMissingSaveFilters();
 
             // Create new directory and files for the current save
-            std::filesystem::create_directory(cwd + "/.cupy/saves/" + std::to_string(saveID));
-            std::ofstream changesFile(cwd + "/.cupy/saves/" + std::to_string(saveID) + "/.changes");
-            std::ofstream saveFile(cwd + "/.cupy/saves/" + std::to_string(saveID) + "/.save");
+            std::filesystem::create_directory(saveDirPath);
+            changesFile.open(saveDirPath + "/.changes");
+            std::ofstream saveFile(saveDirPath + "/.save");
 
             saveFile << getDateTime();
             saveFile << saveMessage;
-                
+
             saveFile.close();
-                
-            for(std::string trackedFile : getTrackedFiles()){
-                std::ifstream trackedFileStream(trackedFile);
-                std::vector<std::string> content;
-
-                // Get the current content of the file
-                std::string line;
-                while(std::getline(trackedFileStream, line)){
-                    content.push_back(line);
-                }
+        };
+
+        // Each file is saved as soon as it has been read and hashed, while the files after it are being read and hashed
+        auto hashFile = [](PipelineFile& file){
+            file.hash = hashStoredContent(file.content);
+        };
+
+        auto saveFile = [&](PipelineFile& file){
+            const std::string& trackedFile = file.path;
+
+            TRACE_SPAN("saveFile", TRACE_COMMAND, trackedFile);
 
-                trackedFileStream.close();
+            // Hand the content over to the project, so checking the file doesn't read or hash it again
+            addFileContent(repo, trackedFile, std::move(file.content), std::move(file.hash));
+
+            if(isReverseStorage()){
+                // Store how to get back to the previous version, and keep this one whole as the newest
+                if(hasFileChanged(repo, trackedFile) || hasNoFullEntry(repo, trackedFile)){
+                    startSave();
 
-                if(hasFileChanged(trackedFile)){
                     log("File has been changed: " + trackedFile);
-                    // Store the path and hash of the file
-                    changesFile << '[' << trackedFile << std::endl;
 
-                    std::string reconstructedString = reconstructSplitString(content);
-                    if(reconstructedString != ""){
-                        changesFile << md5(reconstructedString) << std::endl;
-                    }else{
-                        // Hash of an empty string
-                        changesFile << "d41d8cd98f00b204e9800998ecf8427e" << std::endl;
-                    }
+                    saveReverseEntry(changesFile, trackedFile, getFileContent(repo, trackedFile), getFileHash(repo, trackedFile));
+                    savedPaths.push_back(trackedFile);
+
+                    log(" ");
+                }
 
-                    // Get the changes from previous save
-                    std::string oldContent = rebuildOldFile(trackedFile, getLastSaveID()-1);
+                releaseFileContent(repo, trackedFile);
 
-                    std::vector<std::string> changes = getChanges(oldContent, reconstructSplitString(content));
+                return;
+            }
 
-                    for(std::string change : changes){
-                        changesFile << change << std::endl;
+            if(hasFileChanged(repo, trackedFile)){
+                startSave();
 
-                        int splitPos = change.find_first_of(':');
+                const std::string& content = getFileContent(repo, trackedFile);
 
-                        int lineNum = std::stoi(change.substr(0, splitPos+1));
+                log("File has been changed: " + trackedFile);
+                // Store the path and hash of the file
+                changesFile << '[' << trackedFile << std::endl;
+                savedPaths.push_back(trackedFile);
+                changesFile << getFileHash(repo, trackedFile) << std::endl;
 
-                        std::string newLine = change.substr(splitPos+1);
+                if(isChunkedContent(content)){
+                    // Store large and binary files as chunks, only writing the chunks the store doesn't have yet
+                    int newChunkCount = 0;
+                    std::vector<std::string> chunkHashes = storeChunks(".cupy/chunks", content, &newChunkCount);
 
-                        log("[" + trackedFile + "]" + std::to_string(lineNum) + " => " + newLine);
-                    }
+                    changesFile << CHUNKED_ENTRY_MARKER << std::endl;
 
-                    if(changes.size() >= 1){
-                        log(" ");
+                    for(std::string chunkHash : chunkHashes){
+                        changesFile << chunkHash << std::endl;
                     }
 
                     changesFile << "--------------------" << std::endl;
 
-                // If there's no changes, and the file has never been saved before, save it
-                }else if(hasNoFullEntry(trackedFile)){
-                    changesFile << '[' << trackedFile << std::endl;
-                    changesFile << md5(reconstructSplitString(content)) << std::endl;
-                    changesFile << reconstructSplitString(content) << std::endl;
-                    changesFile << "--------------------" << std::endl;                    
-                
+                    log("[" + trackedFile + "] stored " + std::to_string(newChunkCount) + " new chunk(s) of " + std::to_string(chunkHashes.size()));
+                    log(" ");
+
+                    releaseFileContent(repo, trackedFile);
+
+                    return;
                 }
+
+                // Get the changes from previous save
+                std::string oldContent = rebuildOldFile(repo, trackedFile, saveID-1);
+
+                LineTable changes = getChanges(oldContent, content);
+
+                for(std::string_view change : changes){
+                    changesFile << change << std::endl;
+
+                    size_t splitPos = change.find_first_of(':');
+
+                    int lineNum = parseLineNumber(change);
+
+                    std::string newLine(change.substr(splitPos+1));
+
+                    log("[" + trackedFile + "]" + std::to_string(lineNum) + " => " + newLine);
+                }
+
+                if(changes.size() >= 1){
+                    log(" ");
+                }
+
+                changesFile << "--------------------" << std::endl;
+
+            // If there's no changes, and the file has never been saved before, save it
+            }else if(hasNoFullEntry(repo, trackedFile)){
+                startSave();
+
+                changesFile << '[' << trackedFile << std::endl;
+                savedPaths.push_back(trackedFile);
+                changesFile << getFileHash(repo, trackedFile) << std::endl;
+                changesFile << getFileContent(repo, trackedFile) << std::endl;
+                changesFile << "--------------------" << std::endl;                    
+            
             }
 
-            changesFile.close();
+            // Done with the file, so it isn't all held in memory at once
+            releaseFileContent(repo, trackedFile);
+        };
 
-            log("Saved successfully");
+        runFilePipeline(filesToCheck, hashFile, saveFile);
 
-            return 0;
+        if(!changesFile.is_open()){
+            // The first saves are made even if they'd be empty
+            if(getLastSaveID(repo) > 0){
+                error("No changes detected");
+                return -10;
+            }
+
+            startSave();
         }
+
+        changesFile.close();
+
+        writeSaveFilter(saveID, savedPaths);
+
+        if(isReverseStorage()){
+            // Only now is the save complete, so the versions it staged can become the newest
+            commitStagedHeads(savedPaths);
+        }
+
+        log("Saved successfully");
+
+        return 0;
             
-    }else if(std::string(argv[1]) == "init" && argc == 3){
+    }else if(std::string(argv[1]) == "init" && (argc == 3 || (argc == 4 && std::string(argv[3]) == "--reverse-deltas"))){
         // Initialise
         
         std::string directoryPath = std::string(argv[2]);
@@ -1059,6 +1414,11 @@ int main(int argc, char* argv[]){
             return retCode;
         }
 
+        if(argc == 4){
+            // Keep the newest version of each file whole and store older versions as reverse deltas
+            enableReverseStorage(directoryPath);
+        }
+
         if(directoryPath == "."){
             directoryPath = std::filesystem::current_path().string();
         }
@@ -1080,7 +1440,7 @@ int main(int argc, char* argv[]){
         return 0;
 
     }else{
-        error("Invalid arguments passed. Usage:\ncvcs init <directory>\ncvcs save <message>?\ncvcs add <filename>\ncvcs ignore <filename>\ncvcs rollback <saveID>\ncvcs obliterate <saveID>\ncvcs history\ncvcs status\ncvcs upload <filenames>? @<message>@?\ncvcs download <projectname?>");
+        error("Invalid arguments passed. Usage:\ncvcs init <directory> --reverse-deltas?\ncvcs save <message>?\ncvcs add <filename>\ncvcs ignore <filename>\ncvcs rollback <saveID>\ncvcs obliterate <saveID>\ncvcs history\ncvcs status\ncvcs watch\ncvcs upload <filenames>? @<message>@?\ncvcs download <projectname?>\ncvcs stats\nAdd --trace <file> to any command to record a trace of it");
         return -2;
     }
 
@@ -0,0 +1,350 @@
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+#include "dirWalker.h"
+#include "logger.h"
+#include "trace.h"
+
+#ifdef __linux__
+    #include <sys/syscall.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <dirent.h>
+    #include <cerrno>
+    #include <cstring>
+#endif
+
+#ifdef __linux__
+
+// Entry layout returned by getdents64
+struct LinuxDirent64{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Struct for storing one thread's queue of directories still to be listed
+struct WalkerQueue{
+    std::mutex mutex;
+    std::deque<std::string> directories;
+};
+
+// Struct for storing everything the walker's threads share
+struct WalkerState{
+    std::string basePath;
+    WalkFilter skipEntry;
+
+    std::vector<std::unique_ptr<WalkerQueue>> queues;
+
+    // Directories queued or being listed, the walk is done when this gets to 0
+    std::atomic<size_t> pendingDirectories{0};
+
+    // Directories sitting in a queue, waiting for a thread to list them
+    std::atomic<size_t> queuedDirectories{0};
+
+    // Threads with nothing to list wait here until directories are queued or the walk is done
+    std::mutex idleMutex;
+    std::condition_variable workAvailable;
+
+    // Files found by each thread
+    std::vector<std::vector<std::string>> files;
+};
+
+// Function for getting the full path of something in the walk from its relative path
+// state -> the walker's state
+// relativePath -> path from the directory being walked
+static std::string getWalkPath(const WalkerState& state, const std::string& relativePath){
+    if(relativePath.empty()){
+        return state.basePath;
+    }
+
+    if(!state.basePath.empty() && state.basePath.back() == '/'){
+        return state.basePath + relativePath;
+    }
+
+    return state.basePath + "/" + relativePath;
+}
+
+// Function for waking idle threads after directories have been queued or the walk has finished
+// The idle mutex is taken first, so a thread about to wait either sees the change or is already waiting
+// state -> the walker's state
+// directoryCount -> how many directories were queued (0 when the walk has finished)
+static void wakeIdleThreads(WalkerState& state, size_t directoryCount){
+    {
+        std::lock_guard<std::mutex> lock(state.idleMutex);
+    }
+
+    if(directoryCount == 1){
+        state.workAvailable.notify_one();
+    }else{
+        state.workAvailable.notify_all();
+    }
+}
+
+// Function for taking a directory off the back of a thread's own queue
+// Returns false if the queue is empty
+// queue -> the thread's queue
+// directory -> set to the directory taken
+static bool popOwnDirectory(WalkerQueue& queue, std::string& directory){
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if(queue.directories.empty()){
+        return false;
+    }
+
+    directory = std::move(queue.directories.back());
+    queue.directories.pop_back();
+
+    return true;
+}
+
+// Function for taking a directory off the front of another thread's queue
+// The front holds the directories queued longest ago, which are the nearest the top and usually have the most under them
+// Returns false if every other queue is empty
+// state -> the walker's state
+// threadIndex -> the thread doing the stealing
+// directory -> set to the directory taken
+static bool stealDirectory(WalkerState& state, size_t threadIndex, std::string& directory){
+    for(size_t i=1; i<state.queues.size(); i++){
+        WalkerQueue& queue = *state.queues[(threadIndex + i) % state.queues.size()];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if(!queue.directories.empty()){
+            directory = std::move(queue.directories.front());
+            queue.directories.pop_front();
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Function for listing one directory, queueing its subdirectories and collecting its files
+// state -> the walker's state
+// threadIndex -> the thread listing the directory
+// relativeDir -> the directory to list, from the directory being walked
+static void listDirectory(WalkerState& state, size_t threadIndex, const std::string& relativeDir){
+    std::string dirPath = getWalkPath(state, relativeDir);
+
+    int dirFD = openat(AT_FDCWD, dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if(dirFD < 0){
+        error("Cannot open " + dirPath + ": " + std::strerror(errno));
+        return;
+    }
+
+    std::vector<std::string> subdirectories;
+    std::vector<std::string>& files = state.files[threadIndex];
+
+    alignas(LinuxDirent64) char buffer[WALKER_BUFFER_SIZE];
+
+    while(true){
+        long length = syscall(SYS_getdents64, dirFD, buffer, sizeof(buffer));
+
+        if(length < 0){
+            error("Cannot list " + dirPath + ": " + std::strerror(errno));
+            break;
+        }
+
+        if(length == 0){
+            break;
+        }
+
+        for(long offset=0; offset < length;){
+            LinuxDirent64* entry = reinterpret_cast<LinuxDirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            const char* name = entry->d_name;
+
+            if(std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0){
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+
+            // Only stat when d_type doesn't say, or to see what a symlink points at
+            if(type == DT_UNKNOWN || type == DT_LNK){
+                struct stat info;
+
+                if(fstatat(dirFD, name, &info, type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) != 0){
+                    continue;
+                }
+
+                if(S_ISDIR(info.st_mode)){
+                    // Symlinked directories aren't followed
+                    if(type == DT_LNK){
+                        continue;
+                    }
+
+                    type = DT_DIR;
+                }else{
+                    type = DT_REG;
+                }
+            }
+
+            bool isDirectory = type == DT_DIR;
+            std::string relativePath = relativeDir.empty() ? std::string(name) : relativeDir + "/" + name;
+
+            if(state.skipEntry && state.skipEntry(relativePath, isDirectory)){
+                continue;
+            }
+
+            if(isDirectory){
+                subdirectories.push_back(std::move(relativePath));
+            }else{
+                files.push_back(getWalkPath(state, relativePath));
+            }
+        }
+    }
+
+    close(dirFD);
+
+    if(!subdirectories.empty()){
+        // Counted before this directory is marked done, so the count never reaches 0 early
+        state.pendingDirectories.fetch_add(subdirectories.size());
+
+        WalkerQueue& queue = *state.queues[threadIndex];
+
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            for(std::string& subdirectory : subdirectories){
+                queue.directories.push_back(std::move(subdirectory));
+            }
+        }
+
+        state.queuedDirectories.fetch_add(subdirectories.size());
+
+        wakeIdleThreads(state, subdirectories.size());
+    }
+}
+
+// Function run by each of the walker's threads
+// state -> the walker's state
+// threadIndex -> index of this thread
+static void runWalkerThread(WalkerState& state, size_t threadIndex){
+    std::string directory;
+
+    while(state.pendingDirectories.load() > 0){
+        if(popOwnDirectory(*state.queues[threadIndex], directory) || stealDirectory(state, threadIndex, directory)){
+            state.queuedDirectories.fetch_sub(1);
+
+            listDirectory(state, threadIndex, directory);
+
+            if(state.pendingDirectories.fetch_sub(1) == 1){
+                // That was the last one, so let every waiting thread finish
+                wakeIdleThreads(state, 0);
+            }
+        }else{
+            // Other threads are still listing (often blocked on a slow getdents64) and may queue more directories,
+            // so sleep until they do rather than spinning
+            std::unique_lock<std::mutex> lock(state.idleMutex);
+
+            state.workAvailable.wait(lock, [&state](){
+                return state.queuedDirectories.load() > 0 || state.pendingDirectories.load() == 0;
+            });
+        }
+    }
+}
+
+std::vector<std::string> walkDirectory(std::string directory, WalkFilter skipEntry, unsigned int threadCount){
+    TRACE_SPAN("walkDirectory", TRACE_IO, directory);
+
+    if(threadCount == 0){
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    threadCount = std::min(threadCount, static_cast<unsigned int>(WALKER_MAX_THREADS));
+
+    int rootFD = openat(AT_FDCWD, directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if(rootFD < 0){
+        throw std::runtime_error("Cannot open " + directory + ": " + std::strerror(errno));
+    }
+
+    close(rootFD);
+
+    WalkerState state;
+    state.basePath = directory;
+    state.skipEntry = skipEntry;
+    state.files.resize(threadCount);
+
+    for(unsigned int i=0; i<threadCount; i++){
+        state.queues.push_back(std::unique_ptr<WalkerQueue>(new WalkerQueue()));
+    }
+
+    state.queues[0]->directories.push_back("");
+    state.pendingDirectories.store(1);
+    state.queuedDirectories.store(1);
+
+    std::vector<std::thread> threads;
+
+    for(unsigned int i=1; i<threadCount; i++){
+        threads.emplace_back(runWalkerThread, std::ref(state), i);
+    }
+
+    runWalkerThread(state, 0);
+
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+
+    std::vector<std::string> allFiles;
+
+    for(std::vector<std::string>& files : state.files){
+        allFiles.insert(allFiles.end(), std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+    }
+
+    // Threads finish directories in any order, so sort to give the same result every time
+    std::sort(allFiles.begin(), allFiles.end());
+
+    return allFiles;
+}
+
+#else
+
+std::vector<std::string> walkDirectory(std::string directory, WalkFilter skipEntry, unsigned int threadCount){
+    TRACE_SPAN("walkDirectory", TRACE_IO, directory);
+    std::vector<std::string> allFiles;
+
+    size_t prefixLength = directory.size() + (!directory.empty() && directory.back() == '/' ? 0 : 1);
+
+    auto iterator = std::filesystem::recursive_directory_iterator(directory);
+
+    for(; iterator != std::filesystem::end(iterator); ++iterator){
+        const std::filesystem::directory_entry& entry = *iterator;
+
+        std::string entryPath = entry.path().string();
+        bool isDirectory = entry.is_directory();
+
+        if(skipEntry && skipEntry(entryPath.substr(prefixLength), isDirectory)){
+            if(isDirectory){
+                iterator.disable_recursion_pending();
+            }
+
+            continue;
+        }
+
+        if(!isDirectory){
+            allFiles.push_back(entryPath);
+        }
+    }
+
+    std::sort(allFiles.begin(), allFiles.end());
+
+    return allFiles;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef DIRWALKER_H
+#define DIRWALKER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Most threads a directory walk uses (listing is mostly waiting on the filesystem, so this can be above the core count)
+#define WALKER_MAX_THREADS 16
+
+// Size of the buffer each thread reads directory entries into
+#define WALKER_BUFFER_SIZE (64 * 1024)
+
+// Function type for deciding if an entry should be skipped (a skipped directory isn't gone into)
+// Called from the walker's threads, so it must be safe to call from more than one thread at once
+// relativePath -> path of the entry from the directory being walked
+// isDirectory -> true if the entry is a directory
+typedef std::function<bool(const std::string& relativePath, bool isDirectory)> WalkFilter;
+
+// Function for listing every file under a directory, with several threads listing directories at once
+// Each thread works through its own queue of directories and takes from the others' when it runs out. Entries are
+// read with getdents64 and their types come from d_type, so files are only stat'd when the filesystem doesn't say
+// what they are or they're symlinks. Symlinks to directories aren't followed or returned
+// Returns the paths of the files (the directory followed by their path inside it), sorted
+// Throws a runtime_error if the directory can't be opened
+// directory -> the directory to walk
+// skipEntry -> decides which entries to skip
+// threadCount -> threads to use (0 for one per core, up to WALKER_MAX_THREADS)
+std::vector<std::string> walkDirectory(std::string directory, WalkFilter skipEntry, unsigned int threadCount = 0);
+
+#endif
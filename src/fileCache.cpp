@@ -0,0 +1,62 @@
+#include "fileCache.h"
+
+FileCache::FileCache(size_t maxBytes) : maxBytes(maxBytes), currentBytes(0){
+}
+
+bool FileCache::get(const std::string& key, CachedFile& cachedFile){
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = entryLookup.find(key);
+
+    if(found == entryLookup.end()){
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, found->second);
+    cachedFile = found->second->second;
+
+    return true;
+}
+
+void FileCache::put(const std::string& key, const std::string& content, const std::string& hash){
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = entryLookup.find(key);
+
+    if(found != entryLookup.end()){
+        currentBytes -= found->second->second.content.size();
+        entries.erase(found->second);
+        entryLookup.erase(found);
+    }
+
+    // Don't let one huge file push everything else out
+    if(content.size() > maxBytes / 8){
+        return;
+    }
+
+    entries.push_front({key, {content, hash}});
+    entryLookup[key] = entries.begin();
+    currentBytes += content.size();
+
+    evict();
+}
+
+void FileCache::erase(const std::string& key){
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = entryLookup.find(key);
+
+    if(found != entryLookup.end()){
+        currentBytes -= found->second->second.content.size();
+        entries.erase(found->second);
+        entryLookup.erase(found);
+    }
+}
+
+void FileCache::evict(){
+    while(currentBytes > maxBytes && !entries.empty()){
+        currentBytes -= entries.back().second.content.size();
+        entryLookup.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstddef>
+
+// Struct for storing the latest saved version of a file
+struct CachedFile{
+    std::string content;
+    std::string hash;
+};
+
+// Least recently used cache of the latest saved version of files, bounded by the total size of the cached content
+// Safe to use from several threads at once
+class FileCache{
+public:
+    // maxBytes -> most content (in bytes) to keep cached before evicting the least recently used files
+    FileCache(size_t maxBytes);
+
+    // Function for getting a cached file, moving it to the front of the cache
+    // key -> the file's key
+    // cachedFile -> set to the cached file if found
+    bool get(const std::string& key, CachedFile& cachedFile);
+
+    // Function for setting the cached version of a file (content too big to cache removes any older version instead)
+    // key -> the file's key
+    // content -> the file's latest content
+    // hash -> hash of the content
+    void put(const std::string& key, const std::string& content, const std::string& hash);
+
+    // Function for removing a file from the cache
+    // key -> the file's key
+    void erase(const std::string& key);
+
+private:
+    typedef std::list<std::pair<std::string, CachedFile>> EntryList;
+
+    void evict();
+
+    size_t maxBytes;
+    size_t currentBytes;
+
+    // Most recently used at the front
+    EntryList entries;
+    std::unordered_map<std::string, EntryList::iterator> entryLookup;
+
+    std::mutex mutex;
+};
+
+#endif
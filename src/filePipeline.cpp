@@ -0,0 +1,197 @@
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+
+#include "filePipeline.h"
+#include "utils.h"
+#include "trace.h"
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+// Struct for storing the queue between two stages of a pipeline
+struct PipelineQueue{
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+    std::deque<PipelineFile> files;
+
+    // Set once the stage before it has nothing more to add
+    bool finished = false;
+
+    // Set if a stage failed, so every stage gives up
+    bool stopped = false;
+};
+
+// Function for adding a file to a queue, waiting while it's full
+// Returns false if the pipeline has been stopped
+// queue -> the queue
+// file -> the file to add
+static bool pushFile(PipelineQueue& queue, PipelineFile&& file){
+    std::unique_lock<std::mutex> lock(queue.mutex);
+
+    queue.notFull.wait(lock, [&queue](){
+        return queue.stopped || queue.files.size() < PIPELINE_QUEUE_DEPTH;
+    });
+
+    if(queue.stopped){
+        return false;
+    }
+
+    queue.files.push_back(std::move(file));
+    queue.notEmpty.notify_one();
+
+    return true;
+}
+
+// Function for taking the next file off a queue, waiting while it's empty
+// Returns false once every file has been taken, or if the pipeline has been stopped
+// queue -> the queue
+// file -> set to the file taken
+static bool popFile(PipelineQueue& queue, PipelineFile& file){
+    std::unique_lock<std::mutex> lock(queue.mutex);
+
+    queue.notEmpty.wait(lock, [&queue](){
+        return queue.stopped || queue.finished || !queue.files.empty();
+    });
+
+    if(queue.stopped || queue.files.empty()){
+        return false;
+    }
+
+    file = std::move(queue.files.front());
+    queue.files.pop_front();
+    queue.notFull.notify_one();
+
+    return true;
+}
+
+// Function for marking that nothing more will be added to a queue
+// queue -> the queue
+static void finishQueue(PipelineQueue& queue){
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    queue.finished = true;
+    queue.notEmpty.notify_all();
+}
+
+// Function for stopping a queue, waking anything waiting on it
+// queue -> the queue
+static void stopQueue(PipelineQueue& queue){
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    queue.stopped = true;
+    queue.notFull.notify_all();
+    queue.notEmpty.notify_all();
+}
+
+// Function for asking the kernel to start reading a file into the page cache, without waiting for it
+// filePath -> the file
+static void adviseWillNeed(const std::string& filePath){
+#ifdef __linux__
+    int fileFD = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if(fileFD < 0){
+        return;
+    }
+
+    posix_fadvise(fileFD, 0, 0, POSIX_FADV_WILLNEED);
+
+    close(fileFD);
+#endif
+}
+
+void runFilePipeline(const std::vector<std::string>& filePaths, PipelineStage process, PipelineStage finish){
+    TRACE_SPAN("runFilePipeline", TRACE_IO);
+
+    if(filePaths.empty()){
+        return;
+    }
+
+    PipelineQueue readQueue;
+    PipelineQueue processQueue;
+
+    // First thing to fail, rethrown once every stage has stopped
+    std::mutex failureMutex;
+    std::exception_ptr failure;
+
+    auto fail = [&](){
+        std::lock_guard<std::mutex> lock(failureMutex);
+
+        if(!failure){
+            failure = std::current_exception();
+        }
+
+        stopQueue(readQueue);
+        stopQueue(processQueue);
+    };
+
+    std::thread reader([&](){
+        try{
+            size_t advised = 0;
+
+            for(size_t i=0; i<filePaths.size(); i++){
+                // Keep the kernel reading ahead of the file being read
+                for(; advised < filePaths.size() && advised <= i + PIPELINE_READAHEAD_FILES; advised++){
+                    adviseWillNeed(filePaths[advised]);
+                }
+
+                PipelineFile file;
+                file.index = i;
+                file.path = filePaths[i];
+                file.content = readFileContent(file.path);
+
+                if(!pushFile(readQueue, std::move(file))){
+                    break;
+                }
+            }
+
+            finishQueue(readQueue);
+
+        }catch(...){
+            fail();
+        }
+    });
+
+    std::thread processor([&](){
+        try{
+            PipelineFile file;
+
+            while(popFile(readQueue, file)){
+                process(file);
+
+                if(!pushFile(processQueue, std::move(file))){
+                    break;
+                }
+            }
+
+            finishQueue(processQueue);
+
+        }catch(...){
+            fail();
+        }
+    });
+
+    try{
+        PipelineFile file;
+
+        while(popFile(processQueue, file)){
+            finish(file);
+        }
+
+    }catch(...){
+        fail();
+    }
+
+    reader.join();
+    processor.join();
+
+    if(failure){
+        std::rethrow_exception(failure);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef FILEPIPELINE_H
+#define FILEPIPELINE_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+#include "chunker.h"
+
+// Most files waiting between two stages (2 is double buffering, one being worked on and one ready behind it)
+#define PIPELINE_QUEUE_DEPTH 2
+
+// How many files ahead of the one being read the kernel is asked to start reading
+#define PIPELINE_READAHEAD_FILES 8
+
+// Struct for storing a file as it goes through a pipeline
+struct PipelineFile{
+    // Position of the file in the list the pipeline was given
+    size_t index;
+    std::string path;
+
+    // Content the way it is stored in saves (see readFileContent), filled in by the read stage
+    std::string content;
+
+    // Filled in by the process stage, for whichever of them it works out
+    std::string hash;
+    std::vector<ChunkSpan> chunks;
+    std::vector<std::string> chunkHashes;
+};
+
+// Function type for a stage of a pipeline
+typedef std::function<void(PipelineFile& file)> PipelineStage;
+
+// Function for running files through three stages at once: read -> process -> finish
+// The read stage has its own thread, and asks the kernel to start reading the next few files while it reads one, so
+// cold files come off the disk together. The process stage (hashing, chunking) has its own thread too, and finish
+// runs on the calling thread, getting the files in order. Stages are joined by queues that hold at most
+// PIPELINE_QUEUE_DEPTH files, so only a few files are in memory however many there are, and the whole run takes about
+// as long as its slowest stage rather than the sum of them
+// Anything thrown by a stage stops the pipeline and is rethrown here
+// filePaths -> the files to run through
+// process -> works out what finish needs from a file, runs on its own thread so it must not touch anything shared
+// finish -> uses each file, in the order they were given
+void runFilePipeline(const std::vector<std::string>& filePaths, PipelineStage process, PipelineStage finish);
+
+#endif
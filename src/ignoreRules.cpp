@@ -0,0 +1,337 @@
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+
+#include "ignoreRules.h"
+#include "logger.h"
+#include "dirWalker.h"
+
+// Function for compiling a glob pattern into tokens
+// pattern -> the pattern (without any leading or trailing /)
+static std::vector<GlobToken> compileGlob(const std::string& pattern){
+    std::vector<GlobToken> tokens;
+
+    // Function for adding a character to the literal token at the end, starting a new one if needed
+    auto addLiteralChar = [&tokens](char c){
+        if(tokens.empty() || tokens.back().type != GLOB_LITERAL){
+            GlobToken token = {};
+            token.type = GLOB_LITERAL;
+            tokens.push_back(token);
+        }
+
+        tokens.back().literal += c;
+    };
+
+    for(size_t i=0; i<pattern.size(); i++){
+        char c = pattern[i];
+
+        if(c == '\\' && i + 1 < pattern.size()){
+            addLiteralChar(pattern[++i]);
+
+        }else if(c == '*'){
+            GlobToken token = {};
+
+            if(i + 1 < pattern.size() && pattern[i + 1] == '*'){
+                i++;
+
+                if(i + 1 < pattern.size() && pattern[i + 1] == '/'){
+                    i++;
+                    token.type = GLOB_ANY_DIRECTORIES;
+                }else{
+                    token.type = GLOB_DOUBLE_STAR;
+                }
+
+            }else{
+                token.type = GLOB_STAR;
+            }
+
+            tokens.push_back(token);
+
+        }else if(c == '?'){
+            GlobToken token = {};
+            token.type = GLOB_ANY_CHAR;
+            tokens.push_back(token);
+
+        }else if(c == '['){
+            size_t classEnd = pattern.find(']', i + 2);
+
+            // No closing bracket, so it's just a [
+            if(classEnd == std::string::npos){
+                addLiteralChar(c);
+                continue;
+            }
+
+            GlobToken token = {};
+            token.type = GLOB_CLASS;
+
+            size_t classStart = i + 1;
+            bool negated = pattern[classStart] == '!' || pattern[classStart] == '^';
+
+            if(negated){
+                classStart++;
+            }
+
+            for(size_t j=classStart; j<classEnd; j++){
+                unsigned char first = pattern[j];
+                unsigned char last = first;
+
+                if(j + 2 < classEnd && pattern[j + 1] == '-'){
+                    last = pattern[j + 2];
+                    j += 2;
+                }
+
+                for(unsigned int k=first; k<=last; k++){
+                    token.classChars[k] = true;
+                }
+            }
+
+            if(negated){
+                for(bool& classChar : token.classChars){
+                    classChar = !classChar;
+                }
+            }
+
+            // Only ** crosses directories
+            token.classChars[static_cast<unsigned char>('/')] = false;
+
+            tokens.push_back(token);
+            i = classEnd;
+
+        }else{
+            addLiteralChar(c);
+        }
+    }
+
+    return tokens;
+}
+
+// Function for matching text against compiled glob tokens
+// tokens -> the compiled pattern
+// tokenIndex -> the token to start matching from
+// text -> the text to match
+// textPos -> where in the text to start matching from
+static bool matchGlob(const std::vector<GlobToken>& tokens, size_t tokenIndex, const std::string& text, size_t textPos){
+    for(; tokenIndex < tokens.size(); tokenIndex++){
+        const GlobToken& token = tokens[tokenIndex];
+
+        switch(token.type){
+            case GLOB_LITERAL:
+                if(text.compare(textPos, token.literal.size(), token.literal) != 0){
+                    return false;
+                }
+
+                textPos += token.literal.size();
+                break;
+
+            case GLOB_ANY_CHAR:
+                if(textPos >= text.size() || text[textPos] == '/'){
+                    return false;
+                }
+
+                textPos++;
+                break;
+
+            case GLOB_CLASS:
+                if(textPos >= text.size() || !token.classChars[static_cast<unsigned char>(text[textPos])]){
+                    return false;
+                }
+
+                textPos++;
+                break;
+
+            case GLOB_STAR:
+                // Try every length up to the next /
+                for(size_t end = textPos; ; end++){
+                    if(matchGlob(tokens, tokenIndex + 1, text, end)){
+                        return true;
+                    }
+
+                    if(end >= text.size() || text[end] == '/'){
+                        return false;
+                    }
+                }
+
+            case GLOB_DOUBLE_STAR:
+                for(size_t end = textPos; end <= text.size(); end++){
+                    if(matchGlob(tokens, tokenIndex + 1, text, end)){
+                        return true;
+                    }
+                }
+
+                return false;
+
+            case GLOB_ANY_DIRECTORIES:
+                // Zero directories, or up to and including any / after this point
+                if(matchGlob(tokens, tokenIndex + 1, text, textPos)){
+                    return true;
+                }
+
+                for(size_t end = text.find('/', textPos); end != std::string::npos; end = text.find('/', end + 1)){
+                    if(matchGlob(tokens, tokenIndex + 1, text, end + 1)){
+                        return true;
+                    }
+                }
+
+                return false;
+        }
+    }
+
+    return textPos == text.size();
+}
+
+// Function for getting a path relative to the project directory
+// Returns false if the path is outside the project directory
+// rules -> the compiled rules (for the project directory)
+// path -> the path to convert
+// relativePath -> set to the path from the project directory ("" for the project directory itself)
+static bool getRelativePath(const IgnoreRules& rules, const std::string& path, std::string& relativePath){
+    std::filesystem::path relative = std::filesystem::path(path).lexically_normal().lexically_relative(rules.rootPath);
+
+    relativePath = relative.string();
+
+    if(relativePath.empty() || relativePath == ".." || relativePath.compare(0, 3, "../") == 0){
+        return false;
+    }
+
+    if(relativePath == "."){
+        relativePath = "";
+    }
+
+    // lexically_normal leaves a trailing / on directories given with one
+    while(!relativePath.empty() && relativePath.back() == '/'){
+        relativePath.pop_back();
+    }
+
+    return true;
+}
+
+IgnoreRules loadIgnoreRules(std::string rootPath){
+    IgnoreRules rules;
+    rules.rootPath = std::filesystem::path(rootPath).lexically_normal().string();
+
+    rules.directoryNames.insert(".cupy");
+
+    std::ifstream ignoreFile(rules.rootPath + "/" + IGNORE_FILE_NAME);
+
+    std::string line;
+    while(std::getline(ignoreFile, line)){
+        while(!line.empty() && (line.back() == '\r' || line.back() == ' ')){
+            line.pop_back();
+        }
+
+        if(line.empty() || line[0] == '#'){
+            continue;
+        }
+
+        if(line[0] == '!'){
+            error(std::string(IGNORE_FILE_NAME ": negated patterns aren't supported, skipping ") + line);
+            continue;
+        }
+
+        bool directoryOnly = line.back() == '/';
+        while(!line.empty() && line.back() == '/'){
+            line.pop_back();
+        }
+
+        bool anchored = line.find('/') != std::string::npos;
+        while(!line.empty() && line[0] == '/'){
+            line.erase(0, 1);
+        }
+
+        if(line.empty()){
+            continue;
+        }
+
+        if(line.find_first_of("*?[\\") == std::string::npos){
+            // No wildcards, so it can be looked up directly
+            if(anchored){
+                (directoryOnly ? rules.directoryPaths : rules.paths).insert(line);
+            }else{
+                (directoryOnly ? rules.directoryNames : rules.names).insert(line);
+            }
+
+        }else if(!anchored && !directoryOnly && line.size() > 2 && line.compare(0, 2, "*.") == 0 && line.find_first_of("*?[\\.", 2) == std::string::npos){
+            // A plain *.ext pattern
+            rules.extensions.insert(line.substr(2));
+
+        }else{
+            GlobPattern glob;
+            glob.tokens = compileGlob(line);
+            glob.anchored = anchored;
+            glob.directoryOnly = directoryOnly;
+
+            rules.globs.push_back(glob);
+        }
+    }
+
+    return rules;
+}
+
+bool matchesIgnoreRules(const IgnoreRules& rules, const std::string& relativePath, bool isDirectory){
+    size_t splitPos = relativePath.find_last_of('/');
+    std::string name = splitPos == std::string::npos ? relativePath : relativePath.substr(splitPos + 1);
+
+    if(rules.names.count(name) > 0 || rules.paths.count(relativePath) > 0){
+        return true;
+    }
+
+    if(isDirectory && (rules.directoryNames.count(name) > 0 || rules.directoryPaths.count(relativePath) > 0)){
+        return true;
+    }
+
+    size_t extensionPos = name.find_last_of('.');
+    if(extensionPos != std::string::npos && rules.extensions.count(name.substr(extensionPos + 1)) > 0){
+        return true;
+    }
+
+    for(const GlobPattern& glob : rules.globs){
+        if(glob.directoryOnly && !isDirectory){
+            continue;
+        }
+
+        if(matchGlob(glob.tokens, 0, glob.anchored ? relativePath : name, 0)){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool isIgnoredPath(const IgnoreRules& rules, std::string path, bool isDirectory){
+    std::string relativePath;
+
+    if(!getRelativePath(rules, path, relativePath) || relativePath.empty()){
+        return false;
+    }
+
+    // Check every directory the path is in, from the project directory down
+    for(size_t splitPos = relativePath.find('/'); splitPos != std::string::npos; splitPos = relativePath.find('/', splitPos + 1)){
+        if(matchesIgnoreRules(rules, relativePath.substr(0, splitPos), true)){
+            return true;
+        }
+    }
+
+    return matchesIgnoreRules(rules, relativePath, isDirectory);
+}
+
+void forEachUnignoredFile(const IgnoreRules& rules, std::string directory, std::function<void(const std::string&)> onFile){
+    std::string relativeDir;
+    bool insideProject = getRelativePath(rules, directory, relativeDir);
+
+    if(insideProject && isIgnoredPath(rules, directory, true)){
+        return;
+    }
+
+    WalkFilter skipEntry = nullptr;
+
+    if(insideProject){
+        skipEntry = [&rules, &relativeDir](const std::string& relativePath, bool isDirectory){
+            return matchesIgnoreRules(rules, relativeDir.empty() ? relativePath : relativeDir + "/" + relativePath, isDirectory);
+        };
+    }
+
+    // The walk is done in parallel, but the files are handed over from this thread in sorted order
+    for(const std::string& filePath : walkDirectory(directory, skipEntry)){
+        onFile(filePath);
+    }
+}
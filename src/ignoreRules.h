@@ -0,0 +1,86 @@
+#ifndef IGNORERULES_H
+#define IGNORERULES_H
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <functional>
+
+// File in the project directory listing the paths cvcs should never track
+#define IGNORE_FILE_NAME ".cupyignore"
+
+// Types of token in a compiled glob pattern
+enum GlobTokenType{
+    GLOB_LITERAL,
+    GLOB_ANY_CHAR,
+    GLOB_STAR,
+    GLOB_DOUBLE_STAR,
+    GLOB_ANY_DIRECTORIES,
+    GLOB_CLASS
+};
+
+// Struct for storing one token of a compiled glob pattern
+// * (GLOB_STAR) and ? (GLOB_ANY_CHAR) never match a /, ** (GLOB_DOUBLE_STAR) matches anything and **/
+// (GLOB_ANY_DIRECTORIES) matches zero or more whole directories
+struct GlobToken{
+    GlobTokenType type;
+
+    // Text of a GLOB_LITERAL token
+    std::string literal;
+
+    // Characters a GLOB_CLASS token matches (after applying negation)
+    bool classChars[256];
+};
+
+// Struct for storing a pattern that has wildcards in it
+struct GlobPattern{
+    std::vector<GlobToken> tokens;
+
+    // Anchored patterns match the path from the project directory, others match just the name at any depth
+    bool anchored;
+    bool directoryOnly;
+};
+
+// Struct for storing the compiled patterns from .cupyignore
+// Patterns without wildcards (and "*.ext" patterns) are matched with a single hash lookup, only the rest go through
+// the glob matcher
+struct IgnoreRules{
+    std::string rootPath;
+
+    std::unordered_set<std::string> names;
+    std::unordered_set<std::string> directoryNames;
+    std::unordered_set<std::string> paths;
+    std::unordered_set<std::string> directoryPaths;
+    std::unordered_set<std::string> extensions;
+
+    std::vector<GlobPattern> globs;
+};
+
+// Function for loading and compiling the patterns in a project's .cupyignore (.cupy is always ignored)
+// Uses the same syntax as .gitignore: # comments, * and ? within a name, ** across directories, [abc] classes, a
+// leading or middle / to anchor to the project directory and a trailing / to only match directories. Negated (!)
+// patterns aren't supported
+// rootPath -> the project directory
+IgnoreRules loadIgnoreRules(std::string rootPath);
+
+// Function for checking if a single file/directory matches the rules, without checking the directories it's in
+// rules -> the compiled rules
+// relativePath -> path from the project directory
+// isDirectory -> true if the path is a directory
+bool matchesIgnoreRules(const IgnoreRules& rules, const std::string& relativePath, bool isDirectory);
+
+// Function for checking if a file/directory is ignored, either itself or because a directory it's in is
+// rules -> the compiled rules
+// path -> path to the file/directory
+// isDirectory -> true if the path is a directory
+bool isIgnoredPath(const IgnoreRules& rules, std::string path, bool isDirectory);
+
+// Function for going through every file in a directory that isn't ignored, in sorted order
+// The directory is listed in parallel by walkDirectory, and ignored directories are never gone into, so nothing
+// inside them gets read or stat'd
+// rules -> the compiled rules
+// directory -> the directory to walk
+// onFile -> called with the path of each file
+void forEachUnignoredFile(const IgnoreRules& rules, std::string directory, std::function<void(const std::string&)> onFile);
+
+#endif
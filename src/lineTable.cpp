@@ -0,0 +1,99 @@
+#include "lineTable.h"
+
+LineTable::Iterator::Iterator(const LineTable* table, size_t lineIndex) : table(table), lineIndex(lineIndex){
+}
+
+std::string_view LineTable::Iterator::operator*() const{
+    return (*table)[lineIndex];
+}
+
+LineTable::Iterator& LineTable::Iterator::operator++(){
+    lineIndex++;
+
+    return *this;
+}
+
+bool LineTable::Iterator::operator!=(const Iterator& other) const{
+    return lineIndex != other.lineIndex;
+}
+
+LineTable::LineTable(){
+}
+
+LineTable::LineTable(std::string_view text) : text(text){
+    // Sized for lines of about LINE_TABLE_EXPECTED_LINE_LENGTH chars, rather than counting them first (which takes about as
+    // long as splitting), so most files need one or two allocations
+    lines.reserve(text.size() / LINE_TABLE_EXPECTED_LINE_LENGTH + 1);
+
+    size_t position = 0;
+
+    while(position < text.size()){
+        size_t lineEnd = text.find('\n', position);
+
+        if(lineEnd == std::string_view::npos){
+            lineEnd = text.size();
+        }
+
+        lines.push_back({position, lineEnd - position});
+        position = lineEnd + 1;
+    }
+}
+
+size_t LineTable::size() const{
+    return lines.size();
+}
+
+bool LineTable::empty() const{
+    return lines.empty();
+}
+
+std::string_view LineTable::operator[](size_t lineIndex) const{
+    const LineSpan& line = lines[lineIndex];
+
+    if(line.length == 0){
+        return std::string_view();
+    }
+
+    if(line.offset < text.size()){
+        return text.substr(line.offset, line.length);
+    }
+
+    return std::string_view(arena.data() + (line.offset - text.size()), line.length);
+}
+
+LineTable::Iterator LineTable::begin() const{
+    return Iterator(this, 0);
+}
+
+LineTable::Iterator LineTable::end() const{
+    return Iterator(this, lines.size());
+}
+
+void LineTable::push_back(std::string_view line){
+    push_back(std::string_view(), line);
+}
+
+void LineTable::push_back(std::string_view prefix, std::string_view line){
+    // Offsets rather than pointers, so the arena can grow without breaking the lines already in it
+    lines.push_back({text.size() + arena.size(), prefix.size() + line.size()});
+
+    arena.append(prefix);
+    arena.append(line);
+}
+
+void LineTable::set(size_t lineIndex, std::string_view line){
+    // The old line is left where it is, the arena only grows
+    lines[lineIndex] = {text.size() + arena.size(), line.size()};
+
+    arena.append(line);
+}
+
+void LineTable::resize(size_t lineCount){
+    lines.resize(lineCount, {0, 0});
+}
+
+void LineTable::clear(){
+    text = std::string_view();
+    arena.clear();
+    lines.clear();
+}
@@ -0,0 +1,85 @@
+#ifndef LINETABLE_H
+#define LINETABLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+// Line length a table is first sized for when it's made from some text
+#define LINE_TABLE_EXPECTED_LINE_LENGTH 64
+
+// Struct for storing where a line sits in a LineTable's storage
+struct LineSpan{
+    size_t offset;
+    size_t length;
+};
+
+// Class for storing lines as offsets into one buffer, rather than as a string per line
+// Lines of the text it's made from point straight into that text (which must outlive the table), and lines added or
+// replaced afterwards are copied into the table's arena, a buffer that only grows until the table is cleared or freed
+// So splitting, editing and joining a file costs a few allocations however many lines it has
+class LineTable{
+public:
+    // Class for going through the lines of a table
+    class Iterator{
+    public:
+        Iterator(const LineTable* table, size_t lineIndex);
+
+        std::string_view operator*() const;
+        Iterator& operator++();
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        const LineTable* table;
+        size_t lineIndex;
+    };
+
+    // Empty table
+    LineTable();
+
+    // text -> the text to split, the same way as std::getline (not copied)
+    LineTable(std::string_view text);
+
+    // Function for getting how many lines there are
+    size_t size() const;
+
+    // Function for checking if there are no lines
+    bool empty() const;
+
+    // Function for getting a line, without its newline
+    // lineIndex -> index of the line (from 0)
+    std::string_view operator[](size_t lineIndex) const;
+
+    Iterator begin() const;
+    Iterator end() const;
+
+    // Function for adding a line to the end, copied into the arena
+    // line -> the line to add
+    void push_back(std::string_view line);
+
+    // Function for adding a line made of two parts to the end (such as "N:" and a line's content), copied into the arena
+    // prefix -> the start of the line
+    // line -> the rest of the line
+    void push_back(std::string_view prefix, std::string_view line);
+
+    // Function for replacing a line, the new line is copied into the arena
+    // lineIndex -> index of the line (from 0)
+    // line -> the new line
+    void set(size_t lineIndex, std::string_view line);
+
+    // Function for changing how many lines there are, new lines are empty
+    // lineCount -> the number of lines
+    void resize(size_t lineCount);
+
+    // Function for removing every line and the text, keeping the memory already allocated for reuse
+    void clear();
+
+private:
+    // Text the table was made from, offsets past its end are in the arena
+    std::string_view text;
+    std::string arena;
+    std::vector<LineSpan> lines;
+};
+
+#endif
@@ -0,0 +1,276 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#include "logger.h"
+
+// Function for getting the starting log level, from the CVCS_LOG_LEVEL environment variable if it's set
+static LogLevel getStartingLogLevel(){
+    LogLevel level = LOG_LEVEL_INFO;
+
+    const char* name = std::getenv("CVCS_LOG_LEVEL");
+
+    if(name != nullptr){
+        parseLogLevel(name, level);
+    }
+
+    return level;
+}
+
+static std::atomic<int> currentLogLevel{getStartingLogLevel()};
+
+// Struct for storing a log line in the ring buffer
+// sequence says whose turn the slot is: equal to the write position when it's free to write, one past it when
+// it holds a line waiting to be written out
+struct LogSlot{
+    std::atomic<size_t> sequence;
+    LogLevel level;
+    std::string message;
+};
+
+// Bounded multi-producer, single-consumer ring buffer of log lines
+// Producers claim a slot with a compare-and-swap on writePosition, only the writer thread reads
+static LogSlot logRing[LOG_RING_SIZE];
+static std::atomic<size_t> writePosition{0};
+static size_t readPosition = 0;
+
+static std::atomic<bool> writerRunning{false};
+static std::atomic<bool> writerSleeping{false};
+static std::atomic<bool> stopWriter{false};
+static std::thread writerThread;
+
+// Lines written out so far (or skipped), for flushLogs to wait on
+static std::atomic<size_t> linesWritten{0};
+
+static std::mutex writerMutex;
+static std::condition_variable writerWake;
+
+void setLogLevel(LogLevel level){
+    currentLogLevel.store(level, std::memory_order_relaxed);
+}
+
+LogLevel getLogLevel(){
+    return static_cast<LogLevel>(currentLogLevel.load(std::memory_order_relaxed));
+}
+
+bool parseLogLevel(std::string name, LogLevel& level){
+    if(name == "debug"){
+        level = LOG_LEVEL_DEBUG;
+    }else if(name == "info"){
+        level = LOG_LEVEL_INFO;
+    }else if(name == "error"){
+        level = LOG_LEVEL_ERROR;
+    }else{
+        return false;
+    }
+
+    return true;
+}
+
+// Function for getting the prefix of a log line
+// level -> level of the line
+static const char* getLogPrefix(LogLevel level){
+    if(level == LOG_LEVEL_ERROR){
+        return "[-] ";
+    }else if(level == LOG_LEVEL_DEBUG){
+        return "[.] ";
+    }
+
+    return "[!] ";
+}
+
+// Function for adding a log line to the ring buffer
+// Returns false if the ring buffer is full
+// level -> level of the line
+// message -> the line to add
+static bool pushLogLine(LogLevel level, std::string& message){
+    size_t position = writePosition.load(std::memory_order_relaxed);
+
+    while(true){
+        LogSlot& slot = logRing[position & (LOG_RING_SIZE - 1)];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+        if(difference == 0){
+            if(writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                slot.level = level;
+                slot.message = std::move(message);
+                slot.sequence.store(position + 1, std::memory_order_release);
+
+                return true;
+            }
+
+        }else if(difference < 0){
+            // The writer hasn't got to this slot since it was last used
+            return false;
+
+        }else{
+            position = writePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Function for taking the oldest log line out of the ring buffer (only called by the writer thread)
+// Returns false if the ring buffer is empty
+// level -> set to the level of the line
+// message -> set to the line
+static bool popLogLine(LogLevel& level, std::string& message){
+    LogSlot& slot = logRing[readPosition & (LOG_RING_SIZE - 1)];
+
+    if(slot.sequence.load(std::memory_order_acquire) != readPosition + 1){
+        return false;
+    }
+
+    level = slot.level;
+    message = std::move(slot.message);
+
+    slot.sequence.store(readPosition + LOG_RING_SIZE, std::memory_order_release);
+    readPosition++;
+
+    return true;
+}
+
+// Function run by the background writer thread
+// Collects whatever is in the ring buffer into one batch, writes it with a single call and sleeps when idle
+static void runLogWriter(){
+    std::string batch;
+
+    while(true){
+        LogLevel level;
+        std::string message;
+        size_t batchLines = 0;
+
+        while(batchLines < LOG_RING_SIZE && popLogLine(level, message)){
+            batch += getLogPrefix(level);
+            batch += message;
+            batch += '\n';
+
+            batchLines++;
+        }
+
+        if(batchLines > 0){
+            std::fwrite(batch.data(), 1, batch.size(), stdout);
+            std::fflush(stdout);
+
+            batch.clear();
+
+            linesWritten.fetch_add(batchLines, std::memory_order_release);
+
+            // Taking the lock means a flushLogs caller is either waiting already or will see the new count
+            {
+                std::lock_guard<std::mutex> lock(writerMutex);
+            }
+
+            writerWake.notify_all();
+
+            continue;
+        }
+
+        if(stopWriter.load()){
+            return;
+        }
+
+        // Nothing to write, so sleep until a producer wakes the writer (the timeout covers a missed wake-up)
+        std::unique_lock<std::mutex> lock(writerMutex);
+
+        writerSleeping.store(true);
+
+        // Pairs with the fence in writeLog, so either the writer sees the new line or the producer sees it sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(logRing[readPosition & (LOG_RING_SIZE - 1)].sequence.load(std::memory_order_acquire) != readPosition + 1 && !stopWriter.load()){
+            writerWake.wait_for(lock, std::chrono::milliseconds(100));
+        }
+
+        writerSleeping.store(false);
+    }
+}
+
+// Function for stopping the background writer once everything in the ring buffer has been written
+static void stopLogWriter(){
+    if(!writerRunning.load()){
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        stopWriter.store(true);
+    }
+
+    writerWake.notify_all();
+    writerThread.join();
+
+    writerRunning.store(false);
+}
+
+void startLogWriter(){
+    if(writerRunning.load()){
+        return;
+    }
+
+    // Anything written before now is still in stdout's buffer
+    std::cout.flush();
+
+    for(size_t i=0; i<LOG_RING_SIZE; i++){
+        logRing[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    writerThread = std::thread(runLogWriter);
+
+    // Lines only go to the ring buffer once it's ready
+    writerRunning.store(true);
+
+    std::atexit(stopLogWriter);
+}
+
+void writeLog(LogLevel level, std::string message){
+    if(level < getLogLevel()){
+        return;
+    }
+
+    if(!writerRunning.load(std::memory_order_relaxed)){
+        // No writer thread, so write into stdout's buffer and leave flushing to exit (or the next read from stdin)
+        std::cout << getLogPrefix(level) << message << '\n';
+
+        if(level == LOG_LEVEL_ERROR){
+            std::cout.flush();
+        }
+
+        return;
+    }
+
+    // If the writer has fallen a whole ring behind, wait for it rather than drop the line
+    while(!pushLogLine(level, message)){
+        std::this_thread::yield();
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if(writerSleeping.load()){
+        std::lock_guard<std::mutex> lock(writerMutex);
+        writerWake.notify_all();
+    }
+}
+
+void flushLogs(){
+    if(!writerRunning.load()){
+        std::cout.flush();
+        return;
+    }
+
+    size_t target = writePosition.load();
+
+    std::unique_lock<std::mutex> lock(writerMutex);
+    writerWake.notify_all();
+
+    writerWake.wait(lock, [target](){
+        return linesWritten.load(std::memory_order_acquire) >= target;
+    });
+}
@@ -0,0 +1,77 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+#include <sstream>
+#include <type_traits>
+
+// Most log lines waiting for the background writer at once (must be a power of two)
+#define LOG_RING_SIZE 8192
+
+// Levels of log lines, lines below the current level are skipped
+enum LogLevel{
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_ERROR
+};
+
+// Function for setting the lowest level of log line that gets written
+// level -> the lowest level to write
+void setLogLevel(LogLevel level);
+
+// Function for getting the lowest level of log line that gets written
+LogLevel getLogLevel();
+
+// Function for parsing a log level name (debug, info or error)
+// Returns false if the name isn't a level
+// name -> the name to parse
+// level -> set to the parsed level
+bool parseLogLevel(std::string name, LogLevel& level);
+
+// Function for writing a log line
+// Lines go into stdout's buffer (errors are flushed straight away) until startLogWriter is called, and after that
+// through a lock-free ring buffer to a background thread that writes them out in batches
+// level -> level of the line
+// message -> the line to write
+void writeLog(LogLevel level, std::string message);
+
+// Function for starting the background writer thread (it's stopped and drained at exit)
+void startLogWriter();
+
+// Function for waiting until every log line so far has been written out
+void flushLogs();
+
+// Function for converting anything that can be streamed into a log line
+template <typename T>
+std::string toLogString(const T& message){
+    if constexpr(std::is_convertible<T, std::string>::value){
+        return message;
+    }else{
+        std::ostringstream stream;
+        stream << message;
+        return stream.str();
+    }
+}
+
+// General logging functions
+
+template <typename T>
+void error(T errMessage){
+    writeLog(LOG_LEVEL_ERROR, toLogString(errMessage));
+}
+
+template <typename T>
+void log(T message){
+    if(getLogLevel() <= LOG_LEVEL_INFO){
+        writeLog(LOG_LEVEL_INFO, toLogString(message));
+    }
+}
+
+// Debug lines are only compiled in with -DCVCS_DEBUG_LOGS, so building the message costs nothing otherwise
+#ifdef CVCS_DEBUG_LOGS
+    #define LOG_DEBUG(message) do{ if(getLogLevel() <= LOG_LEVEL_DEBUG){ writeLog(LOG_LEVEL_DEBUG, toLogString(message)); } }while(0)
+#else
+    #define LOG_DEBUG(message) do{ }while(0)
+#endif
+
+#endif
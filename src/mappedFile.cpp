@@ -0,0 +1,92 @@
+#include <fstream>
+#include <iterator>
+
+#include "mappedFile.h"
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filePath) : data(nullptr), size(0), mapped(false){
+#ifndef _WIN32
+    int fileFD = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if(fileFD < 0){
+        return;
+    }
+
+    struct stat info;
+    bool regularFile = fstat(fileFD, &info) == 0 && S_ISREG(info.st_mode);
+
+    if(regularFile){
+        size = info.st_size;
+
+        // mmap can't map nothing, an empty file is just an empty view
+        if(size > 0){
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileFD, 0);
+
+            if(mapping != MAP_FAILED){
+                // The file is read through from start to end
+                madvise(mapping, size, MADV_SEQUENTIAL);
+
+                data = static_cast<const char*>(mapping);
+                mapped = true;
+            }
+        }
+    }
+
+    close(fileFD);
+
+    // Anything that isn't a regular file (or couldn't be mapped) is read instead
+    if(mapped || (regularFile && size == 0)){
+        return;
+    }
+#endif
+
+    // Fall back to reading the file into memory
+    std::ifstream file(filePath, std::ios::binary);
+
+    if(!file){
+        return;
+    }
+
+    buffer.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    data = buffer.data();
+    size = buffer.size();
+}
+
+MappedFile::~MappedFile(){
+#ifndef _WIN32
+    if(mapped){
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+}
+
+std::string_view MappedFile::view() const{
+    return std::string_view(data, size);
+}
+
+LineReader::LineReader(std::string_view text) : text(text), position(0){
+}
+
+bool LineReader::next(std::string_view& line){
+    if(position >= text.size()){
+        return false;
+    }
+
+    size_t lineEnd = text.find('\n', position);
+
+    if(lineEnd == std::string_view::npos){
+        lineEnd = text.size();
+    }
+
+    line = text.substr(position, lineEnd - position);
+    position = lineEnd + 1;
+
+    return true;
+}
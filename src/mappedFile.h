@@ -0,0 +1,48 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Read-only view of a whole file, memory mapped so reading it doesn't copy it (on Windows it's read into memory)
+// The view is only valid while the MappedFile is alive
+class MappedFile{
+public:
+    // filePath -> path to the file to map (a file that can't be opened gives an empty view)
+    MappedFile(const std::string& filePath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Function for getting the file's content
+    std::string_view view() const;
+
+private:
+    const char* data;
+    size_t size;
+    bool mapped;
+
+    // Content of the file when it couldn't be mapped
+    std::string buffer;
+};
+
+// Class for going through the lines of some text without copying them, splitting the same way as std::getline
+// Copying a LineReader gives one that carries on from the same place, for looking ahead
+class LineReader{
+public:
+    // text -> the text to read (must outlive the reader)
+    LineReader(std::string_view text);
+
+    // Function for getting the next line, without its newline
+    // Returns false once every line has been read
+    // line -> set to the line
+    bool next(std::string_view& line);
+
+private:
+    std::string_view text;
+    size_t position;
+};
+
+#endif
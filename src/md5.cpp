@@ -354,9 +354,11 @@ std::ostream& operator<<(std::ostream& out, MD5 md5)
  
 //////////////////////////////
  
-std::string md5(const std::string str)
+std::string md5(std::string_view str)
 {
-    MD5 md5 = MD5(str);
+    MD5 md5;
+    md5.update(str.data(), str.size());
+    md5.finalize();
  
     return md5.hexdigest();
 }
\ No newline at end of file
@@ -35,6 +35,7 @@ documentation and/or software.
  
 #include <cstring>
 #include <iostream>
+#include <string_view>
  
  
 // a small class for calculating MD5 hashes of strings or byte arrays
@@ -88,6 +89,6 @@ private:
   static inline void II(uint4 &a, uint4 b, uint4 c, uint4 d, uint4 x, uint4 s, uint4 ac);
 };
  
-std::string md5(const std::string str);
+std::string md5(std::string_view str);
  
 #endif
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <algorithm>
+
+#include "metrics.h"
+#include "networkUtils.h"
+#include "trace.h"
+
+// Names of the commands with their own metrics, in the same order as ServerMetrics::commands
+static const char* metricCommandNames[METRIC_COMMAND_COUNT] = {"upload", "uploadbegin", "uploadchunks", "uploadcommit", "download", "list", "stats", "other"};
+
+// Function for getting the bucket a value goes in
+// value -> the value to find the bucket for
+static int getBucketIndex(uint64_t value){
+    if(value < 8){
+        return static_cast<int>(value);
+    }
+
+    // Top bit picks the power of two, the 3 bits below it pick one of 8 buckets inside it
+    int topBit = 63 - __builtin_clzll(value);
+    int subBucket = static_cast<int>((value >> (topBit - 3)) & 7);
+
+    return (topBit - 2) * 8 + subBucket;
+}
+
+// Function for getting the biggest value that goes in a bucket
+// index -> the bucket's index
+static uint64_t getBucketUpperBound(int index){
+    if(index < 8){
+        return index;
+    }
+
+    int topBit = index / 8 + 2;
+    uint64_t lower = static_cast<uint64_t>(8 + index % 8) << (topBit - 3);
+
+    return lower + (1ULL << (topBit - 3)) - 1;
+}
+
+Histogram::Histogram() : count(0), sum(0), max(0){
+    for(std::atomic<uint64_t>& bucket : buckets){
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::record(uint64_t value){
+    buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t currentMax = max.load(std::memory_order_relaxed);
+    while(value > currentMax && !max.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)){
+    }
+}
+
+uint64_t Histogram::getPercentile(double percentile) const{
+    uint64_t total = count.load(std::memory_order_relaxed);
+
+    if(total == 0){
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(percentile * total);
+    if(target < 1){
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for(int i=0; i<HISTOGRAM_BUCKETS; i++){
+        seen += buckets[i].load(std::memory_order_relaxed);
+
+        if(seen >= target){
+            // The bucket's upper edge can overshoot the biggest value recorded
+            return std::min(getBucketUpperBound(i), max.load(std::memory_order_relaxed));
+        }
+    }
+
+    return max.load(std::memory_order_relaxed);
+}
+
+std::string Histogram::toJson() const{
+    uint64_t total = count.load(std::memory_order_relaxed);
+    double mean = total == 0 ? 0.0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / total;
+
+    char buffer[256];
+    std::snprintf(buffer, sizeof(buffer), "{\"count\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+        static_cast<unsigned long long>(total), mean,
+        static_cast<unsigned long long>(getPercentile(0.50)), static_cast<unsigned long long>(getPercentile(0.90)),
+        static_cast<unsigned long long>(getPercentile(0.99)), static_cast<unsigned long long>(getPercentile(0.999)),
+        static_cast<unsigned long long>(max.load(std::memory_order_relaxed)));
+
+    return buffer;
+}
+
+ServerMetrics::ServerMetrics() : startTime(std::chrono::steady_clock::now()){
+}
+
+void ServerMetrics::recordCommand(const std::string& command, uint64_t microseconds, bool succeeded){
+    int index = METRIC_COMMAND_COUNT - 1;
+
+    for(int i=0; i<METRIC_COMMAND_COUNT - 1; i++){
+        if(command == metricCommandNames[i]){
+            index = i;
+            break;
+        }
+    }
+
+    commands[index].latencyMicroseconds.record(microseconds);
+
+    if(!succeeded){
+        commands[index].errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ServerMetrics::recordCommit(const std::string& projectName, uint64_t microseconds, uint64_t filesStored){
+    ProjectMetrics* projectMetrics;
+
+    {
+        std::lock_guard<std::mutex> lock(projectsMutex);
+
+        std::unique_ptr<ProjectMetrics>& found = projects[projectName];
+
+        if(!found){
+            found.reset(new ProjectMetrics());
+        }
+
+        projectMetrics = found.get();
+    }
+
+    // Entries are never removed, so the pointer stays valid after the lock is released
+    projectMetrics->commitMicroseconds.record(microseconds);
+    projectMetrics->filesStored.fetch_add(filesStored, std::memory_order_relaxed);
+}
+
+std::string ServerMetrics::toJson(){
+    std::chrono::duration<double> uptime = std::chrono::steady_clock::now() - startTime;
+
+    std::string json = "{\n";
+    json += "  \"uptimeSeconds\": " + std::to_string(static_cast<long long>(uptime.count())) + ",\n";
+    json += "  \"bytesIn\": " + std::to_string(networkBytesReceived.load()) + ",\n";
+    json += "  \"bytesOut\": " + std::to_string(networkBytesSent.load()) + ",\n";
+    json += "  \"filesProcessed\": " + std::to_string(filesProcessed.load()) + ",\n";
+    json += "  \"filesStored\": " + std::to_string(filesStored.load()) + ",\n";
+    json += "  \"cacheHits\": " + std::to_string(cacheHits.load()) + ",\n";
+    json += "  \"cacheMisses\": " + std::to_string(cacheMisses.load()) + ",\n";
+    json += "  \"rebuildDepth\": " + rebuildDepth.toJson() + ",\n";
+
+    json += "  \"commands\": {\n";
+
+    for(int i=0; i<METRIC_COMMAND_COUNT; i++){
+        json += "    \"" + std::string(metricCommandNames[i]) + "\": {\"errors\": " + std::to_string(commands[i].errors.load()) + ", \"latencyMicroseconds\": " + commands[i].latencyMicroseconds.toJson() + "}";
+        json += (i + 1 < METRIC_COMMAND_COUNT) ? ",\n" : "\n";
+    }
+
+    json += "  },\n";
+
+    json += "  \"projects\": {";
+
+    {
+        std::lock_guard<std::mutex> lock(projectsMutex);
+
+        bool firstProject = true;
+
+        for(auto& project : projects){
+            json += firstProject ? "\n" : ",\n";
+            json += "    \"" + escapeJson(project.first) + "\": {\"filesStored\": " + std::to_string(project.second->filesStored.load()) + ", \"commitMicroseconds\": " + project.second->commitMicroseconds.toJson() + "}";
+
+            firstProject = false;
+        }
+
+        json += firstProject ? "}\n" : "\n  }\n";
+    }
+
+    json += "}\n";
+
+    return json;
+}
@@ -0,0 +1,91 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+// Buckets in a histogram: 8 per power of two, enough for any 64-bit value
+#define HISTOGRAM_BUCKETS (8 * 64)
+
+// Commands the server keeps separate metrics for (anything else is counted as "other")
+#define METRIC_COMMAND_COUNT 8
+
+// Histogram with log-linear buckets (HDR style), 8 buckets per power of two so every bucket is within 12.5% of the
+// values in it. Recording is lock-free, so it can be updated from any thread
+class Histogram{
+public:
+    Histogram();
+
+    // Function for adding a value to the histogram
+    // value -> the value to add
+    void record(uint64_t value);
+
+    // Function for estimating a percentile from the buckets (the upper edge of the bucket it falls in)
+    // percentile -> the percentile to get (0 to 1)
+    uint64_t getPercentile(double percentile) const;
+
+    // Function for getting the count, mean, percentiles and max as a JSON object
+    std::string toJson() const;
+
+private:
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
+
+// Struct for storing the metrics of one command
+struct CommandMetrics{
+    std::atomic<uint64_t> errors{0};
+    Histogram latencyMicroseconds;
+};
+
+// Struct for storing the metrics of one project
+struct ProjectMetrics{
+    std::atomic<uint64_t> filesStored{0};
+    Histogram commitMicroseconds;
+};
+
+// Counters and histograms for everything the server does, safe to update from any thread
+class ServerMetrics{
+public:
+    ServerMetrics();
+
+    // Function for recording a finished command
+    // command -> the command that was run
+    // microseconds -> how long it took
+    // succeeded -> false if it failed
+    void recordCommand(const std::string& command, uint64_t microseconds, bool succeeded);
+
+    // Function for recording a committed save
+    // projectName -> project the save was committed to
+    // microseconds -> how long the commit took
+    // filesStored -> how many files had an entry written in the save
+    void recordCommit(const std::string& projectName, uint64_t microseconds, uint64_t filesStored);
+
+    // Function for getting every metric as a JSON object
+    std::string toJson();
+
+    std::atomic<uint64_t> filesProcessed{0};
+    std::atomic<uint64_t> filesStored{0};
+    std::atomic<uint64_t> cacheHits{0};
+    std::atomic<uint64_t> cacheMisses{0};
+
+    // Number of .changes entries read to rebuild a file, for files that weren't cached
+    Histogram rebuildDepth;
+
+private:
+    std::chrono::steady_clock::time_point startTime;
+
+    CommandMetrics commands[METRIC_COMMAND_COUNT];
+
+    std::mutex projectsMutex;
+    std::unordered_map<std::string, std::unique_ptr<ProjectMetrics>> projects;
+};
+
+#endif
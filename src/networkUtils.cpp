@@ -1,6 +1,11 @@
 #include <stdexcept>
 #include <cstdint>
+#include <atomic>
 #include "networkUtils.h"
+#include "trace.h"
+
+std::atomic<uint64_t> networkBytesSent{0};
+std::atomic<uint64_t> networkBytesReceived{0};
 
 #ifdef _WIN32
     #include <ws2tcpip.h>
@@ -8,7 +13,10 @@
     #define CLOSESOCKET closesocket
 #else
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <arpa/inet.h>
+    #include <sys/socket.h>
+    #include <sys/uio.h>
     #include <unistd.h>
     #define CLOSESOCKET close
 #endif
@@ -59,6 +67,8 @@ SocketType connectToServer(std::string serverAddress, int port){
         throw std::runtime_error("Cannot connect to server");
     }
 
+    setNoDelay(retSocket);
+
     return retSocket;
 }
 
@@ -74,16 +84,18 @@ ssize_t recvAll(SocketType socket, void* buffer, size_t length){
         #endif
 
         if(n == 0){
-            throw std::runtime_error("Connection closed by peer");
+            throw ConnectionError("Connection closed by peer");
         }
         
         if(n < 0){
-            throw std::runtime_error("recv() failed");
+            throw ConnectionError("recv() failed");
         }
 
         total += n;
     }
 
+    networkBytesReceived.fetch_add(total, std::memory_order_relaxed);
+
     return total;
 }
 
@@ -99,16 +111,19 @@ ssize_t sendAll(SocketType socket, void* buffer, size_t length){
         #endif
 
         if(n <= 0){
-            throw std::runtime_error("send() failed");
+            throw ConnectionError("send() failed");
         }
 
         total += n;
     }
 
+    networkBytesSent.fetch_add(total, std::memory_order_relaxed);
+
     return total;
 }
 
 std::string receiveMessage(SocketType socket){
+    TRACE_SPAN("receiveMessage", TRACE_NET);
     uint32_t tmp;
     recvAll(socket, &tmp, sizeof(tmp));
 
@@ -122,13 +137,130 @@ std::string receiveMessage(SocketType socket){
     return message;
 }
 
-int sendMessage(SocketType socket, std::string message){
+int sendMessage(SocketType socket, std::string_view message){
+    TRACE_SPAN("sendMessage", TRACE_NET);
     uint32_t messageLength = htonl(message.size());
-    sendAll(socket, &messageLength, sizeof(messageLength));
 
-    if(!message.empty()){
-        sendAll(socket, message.data(), message.size());
-    }
+    // Header and content go out in one gathered send straight from where they are, as with Nagle off two sends would
+    // be two packets, and copying them together would copy every file and chunk sent
+    #ifdef _WIN32
+        WSABUF parts[2] = {{sizeof(messageLength), reinterpret_cast<char*>(&messageLength)}, {static_cast<ULONG>(message.size()), const_cast<char*>(message.data())}};
+        DWORD sent = 0;
+
+        // A blocking WSASend only returns once everything has been sent
+        if(WSASend(socket, parts, 2, &sent, 0, nullptr, nullptr) != 0){
+            throw ConnectionError("WSASend() failed");
+        }
+
+        size_t total = sent;
+    #else
+        struct iovec parts[2] = {{&messageLength, sizeof(messageLength)}, {const_cast<char*>(message.data()), message.size()}};
+        struct iovec* remaining = parts;
+        int remainingCount = 2;
+
+        size_t total = 0;
+
+        while(remainingCount > 0){
+            struct msghdr header = {};
+            header.msg_iov = remaining;
+            header.msg_iovlen = remainingCount;
+
+            ssize_t n = sendmsg(socket, &header, 0);
+
+            if(n <= 0){
+                throw ConnectionError("sendmsg() failed");
+            }
+
+            total += n;
+
+            // Skip past whatever was sent, which can end partway through a part
+            while(remainingCount > 0 && static_cast<size_t>(n) >= remaining->iov_len){
+                n -= remaining->iov_len;
+                remaining++;
+                remainingCount--;
+            }
+
+            if(remainingCount > 0){
+                remaining->iov_base = static_cast<char*>(remaining->iov_base) + n;
+                remaining->iov_len -= n;
+            }
+        }
+    #endif
+
+    networkBytesSent.fetch_add(total, std::memory_order_relaxed);
 
     return 0;
-}
\ No newline at end of file
+}
+
+void setNoDelay(SocketType socket){
+    int noDelay = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+}
+
+SocketType openSession(std::string serverAddress, int port){
+    SocketType retSocket = connectToServer(serverAddress, port);
+
+    sendMessage(retSocket, "hello");
+    sendMessage(retSocket, SESSION_PROTOCOL_VERSION);
+
+    std::string greeting = receiveMessage(retSocket);
+    std::string serverVersion = receiveMessage(retSocket);
+
+    if(greeting != "hello" || serverVersion != SESSION_PROTOCOL_VERSION){
+        closeSocket(retSocket);
+
+        throw std::runtime_error("Server doesn't support session protocol version " SESSION_PROTOCOL_VERSION);
+    }
+
+    return retSocket;
+}
+
+int sendRequest(SocketType socket, std::string command){
+    static std::atomic<int> nextRequestID{1};
+
+    int requestID = nextRequestID++;
+
+    sendMessage(socket, std::to_string(requestID));
+    sendMessage(socket, command);
+
+    return requestID;
+}
+
+SessionReply receiveReply(SocketType socket, int requestID){
+    SessionReply reply;
+
+    std::string replyID = receiveMessage(socket);
+
+    if(replyID != std::to_string(requestID)){
+        // Replies come back in order, so any other ID means this side and the server have lost track of each other
+        throw ConnectionError("Expected the reply to request " + std::to_string(requestID) + ", got " + replyID);
+    }
+
+    reply.requestID = requestID;
+
+    int messageCount = std::stoi(receiveMessage(socket));
+
+    // A failed request replies with -1 and the error
+    reply.ok = messageCount >= 0;
+
+    if(!reply.ok){
+        messageCount = 1;
+    }
+
+    for(int i=0; i<messageCount; i++){
+        reply.messages.push_back(receiveMessage(socket));
+    }
+
+    return reply;
+}
+
+void closeSession(SocketType socket){
+    try{
+        int requestID = sendRequest(socket, "close");
+        receiveReply(socket, requestID);
+    }catch(std::runtime_error& err){
+        // Already gone, nothing left to close but the socket
+    }
+
+    closeSocket(socket);
+}
@@ -2,6 +2,11 @@
 #define NETWORKUTILS_H
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -10,6 +15,27 @@
     using SocketType = int;
 #endif
 
+// Version of the keep-alive session protocol, sent by both sides in the handshake
+#define SESSION_PROTOCOL_VERSION "1"
+
+// Struct for storing the reply to a request sent in a session
+struct SessionReply{
+    int requestID;
+    bool ok;
+    std::vector<std::string> messages;
+};
+
+// Error for a connection that can't be used any more (the socket failed, or the other side sent something that
+// can't be followed), as opposed to a single request failing
+class ConnectionError : public std::runtime_error{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Total bytes sent and received over every socket, for the server's metrics
+extern std::atomic<uint64_t> networkBytesSent;
+extern std::atomic<uint64_t> networkBytesReceived;
+
 // For windows only
 void initialiseSockets();
 void cleanupSockets();
@@ -23,6 +49,24 @@ ssize_t recvAll(SocketType socket, void* buffer, size_t length);
 ssize_t sendAll(SocketType socket, void* buffer, size_t length);
 
 std::string receiveMessage(SocketType socket);
-int sendMessage(SocketType socket, std::string message);
+int sendMessage(SocketType socket, std::string_view message);
+
+// Turns off Nagle's algorithm, so small request/reply messages go out straight away
+void setNoDelay(SocketType socket);
+
+// Connects to the server and starts a keep-alive session
+SocketType openSession(std::string serverAddress, int port);
+
+// Starts a request in a session by sending its ID and command (any arguments are then sent with sendMessage)
+// Requests can be sent back to back without waiting for the replies, which come back in the same order
+int sendRequest(SocketType socket, std::string command);
+
+// Receives the reply to the oldest request that hasn't been replied to yet
+// Throws ConnectionError if it's the reply to some other request
+// requestID -> ID of that request, as returned by sendRequest
+SessionReply receiveReply(SocketType socket, int requestID);
+
+// Ends a session and closes the socket
+void closeSession(SocketType socket);
 
 #endif
\ No newline at end of file
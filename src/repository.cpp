@@ -0,0 +1,178 @@
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "repository.h"
+#include "md5.h"
+#include "utils.h"
+#include "trace.h"
+#include "reverseDeltas.h"
+#include "saveFilters.h"
+#include "mappedFile.h"
+
+std::string hashStoredContent(std::string_view content){
+    if(content.empty()){
+        // Hash of an empty string
+        return "d41d8cd98f00b204e9800998ecf8427e";
+    }
+
+    TRACE_SPAN("md5", TRACE_HASH);
+    return md5(content);
+}
+
+// Function for getting the hash a file had at the last save that has an entry for it
+// Returns "" if it has never been saved
+// repo -> the project
+// filePath -> path to the file
+static std::string getSavedHash(const Repository& repo, const std::string& filePath){
+    std::string savedHash = "";
+
+    if(isReverseStorage()){
+        // The newest version's hash is kept with it, so no saves need reading
+        readHeadHash(filePath, savedHash);
+        return savedHash;
+    }
+
+    refreshSaveFilters();
+
+    std::string entryHeader = '[' + filePath;
+
+    // Iterate over all change files in order, keeping the most recent hash
+    for(int saveID : repo.saveIDs){
+        // Skip saves that certainly don't have an entry for the file
+        if(!saveMayTouch(saveID, filePath)){
+            continue;
+        }
+
+        std::string changesFilePath = ".cupy/saves/" + std::to_string(saveID) + "/.changes";
+
+        if(doesFileExist(changesFilePath)){
+            MappedFile changesFile(changesFilePath);
+            LineReader changesLines(changesFile.view());
+
+            std::string_view line;
+            while(changesLines.next(line)){
+                if(line == entryHeader){
+                    if(changesLines.next(line)){
+                        savedHash = std::string(line);
+                    }
+
+                    break;
+                }
+            }
+        }
+    }
+
+    return savedHash;
+}
+
+Repository openRepository(){
+    TRACE_SPAN("openRepository", TRACE_IO);
+    Repository repo;
+
+    std::ifstream projectFile(".cupy/.project");
+    std::getline(projectFile, repo.projectName);
+
+    std::ifstream trackFile(".cupy/.track");
+
+    std::string line;
+    while(std::getline(trackFile, line)){
+        repo.trackedFiles.push_back(line);
+    }
+
+    repo.trackedSet = std::unordered_set<std::string>(repo.trackedFiles.begin(), repo.trackedFiles.end());
+
+    std::error_code err;
+    for(auto saveDir : std::filesystem::directory_iterator(".cupy/saves", err)){
+        try{
+            repo.saveIDs.push_back(std::stoi(saveDir.path().filename().string()));
+        }catch(std::invalid_argument& err){
+            // Ignore non-integer filenames
+        }
+    }
+
+    // Sorted by ID (otherwise would be lexographically)
+    std::sort(repo.saveIDs.begin(), repo.saveIDs.end());
+
+    return repo;
+}
+
+int getLastSaveID(const Repository& repo){
+    return repo.saveIDs.empty() ? -1 : repo.saveIDs.back();
+}
+
+const std::string& getFileContent(Repository& repo, const std::string& filePath){
+    auto found = repo.fileContents.find(filePath);
+
+    if(found != repo.fileContents.end()){
+        return found->second;
+    }
+
+    return repo.fileContents[filePath] = readFileContent(filePath);
+}
+
+void addFileContent(Repository& repo, const std::string& filePath, std::string content, std::string hash){
+    repo.fileContents[filePath] = std::move(content);
+
+    if(!hash.empty()){
+        repo.fileHashes[filePath] = std::move(hash);
+    }
+}
+
+const std::string& getFileHash(Repository& repo, const std::string& filePath){
+    auto found = repo.fileHashes.find(filePath);
+
+    if(found != repo.fileHashes.end()){
+        return found->second;
+    }
+
+    return repo.fileHashes[filePath] = hashStoredContent(getFileContent(repo, filePath));
+}
+
+bool hasFileChanged(Repository& repo, const std::string& filePath){
+    auto checked = repo.changedFiles.find(filePath);
+
+    if(checked != repo.changedFiles.end()){
+        return checked->second;
+    }
+
+    TRACE_SPAN("hasFileChanged", TRACE_HASH, filePath);
+    std::string savedHash = getSavedHash(repo, filePath);
+
+    bool changed;
+
+    if(repo.fileHashes.count(filePath) > 0 || repo.fileContents.count(filePath) > 0){
+        changed = savedHash != getFileHash(repo, filePath);
+
+    }else{
+        // Map the file and hash it in place, only copying it if it has changed (and so will be needed again)
+        MappedFile file(filePath);
+        std::string_view content = getStoredContent(file.view());
+
+        std::string hash = hashStoredContent(content);
+
+        // A file that has never been saved has changed too
+        changed = savedHash != hash;
+
+        if(changed){
+            repo.fileContents[filePath] = std::string(content);
+        }
+
+        repo.fileHashes[filePath] = hash;
+    }
+
+    repo.changedFiles[filePath] = changed;
+
+    return changed;
+}
+
+void releaseFileContent(Repository& repo, const std::string& filePath){
+    repo.fileContents.erase(filePath);
+}
+
+void forgetFile(Repository& repo, const std::string& filePath){
+    repo.fileContents.erase(filePath);
+    repo.fileHashes.erase(filePath);
+    repo.changedFiles.erase(filePath);
+}
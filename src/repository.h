@@ -0,0 +1,73 @@
+#ifndef REPOSITORY_H
+#define REPOSITORY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+// Struct for storing what a command has read of the project, so nothing is read more than once per command
+// Opened once at the start of a command with openRepository and passed to everything that needs it
+struct Repository{
+    // Name of the project, from .cupy/.project
+    std::string projectName;
+
+    // Tracked files in the order they are in .track, and as a set for lookups
+    std::vector<std::string> trackedFiles;
+    std::unordered_set<std::string> trackedSet;
+
+    // IDs of the saves, oldest first
+    std::vector<int> saveIDs;
+
+    // Working tree files this command has read, hashed or checked against the last save
+    std::unordered_map<std::string, std::string> fileContents;
+    std::unordered_map<std::string, std::string> fileHashes;
+    std::unordered_map<std::string, bool> changedFiles;
+};
+
+// Function for loading the project in the current directory
+Repository openRepository();
+
+// Function for getting the ID of the last save (-1 if there are none)
+// repo -> the project
+int getLastSaveID(const Repository& repo);
+
+// Function for getting a file's content the way it is stored in saves (see readFileContent), reading it the first time
+// repo -> the project
+// filePath -> path to the file
+const std::string& getFileContent(Repository& repo, const std::string& filePath);
+
+// Function for handing over a file's content that was read some other way (such as by a pipeline), so it isn't read again
+// repo -> the project
+// filePath -> path to the file
+// content -> the file's content, the way it is stored in saves
+// hash -> the content's hash from hashStoredContent ("" if it hasn't been worked out)
+void addFileContent(Repository& repo, const std::string& filePath, std::string content, std::string hash = "");
+
+// Function for hashing content the way saves do
+// content -> the content to hash
+std::string hashStoredContent(std::string_view content);
+
+// Function for getting the hash of a file's content, hashing it the first time
+// repo -> the project
+// filePath -> path to the file
+const std::string& getFileHash(Repository& repo, const std::string& filePath);
+
+// Function for checking if a file has changed from the previous save
+// The content of a changed file is kept, as whatever asked will want it next
+// repo -> the project
+// filePath -> path to file that is being checked
+bool hasFileChanged(Repository& repo, const std::string& filePath);
+
+// Function for dropping a file's content once the command is done with it (its hash is kept)
+// repo -> the project
+// filePath -> path to the file
+void releaseFileContent(Repository& repo, const std::string& filePath);
+
+// Function for forgetting everything read of a file, after the command has written to it
+// repo -> the project
+// filePath -> path to the file
+void forgetFile(Repository& repo, const std::string& filePath);
+
+#endif
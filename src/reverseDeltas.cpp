@@ -0,0 +1,305 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+#include "reverseDeltas.h"
+#include "md5.h"
+#include "utils.h"
+#include "chunker.h"
+#include "trace.h"
+#include "logger.h"
+#include "saveFilters.h"
+#include "mappedFile.h"
+#include "repository.h"
+
+// Function for getting the path a file's newest version is kept at
+// filePath -> path to the file
+static std::string getHeadPath(const std::string& filePath){
+    return std::string(HEAD_DIR_PATH) + "/" + md5(filePath);
+}
+
+// Function for getting the path a file's next newest version waits at until its save is complete
+// filePath -> path to the file
+static std::string getStagedHeadPath(const std::string& filePath){
+    return getHeadPath(filePath) + HEAD_STAGED_SUFFIX;
+}
+
+// Function for reading the newest saved version of a file
+// Returns false if the file has never been saved
+// filePath -> path to the file
+// hash -> set to the hash of the newest version
+// content -> set to the newest version
+static bool readHead(const std::string& filePath, std::string& hash, std::string& content){
+    TRACE_SPAN("readHead", TRACE_IO, filePath);
+    MappedFile headFile(getHeadPath(filePath));
+
+    std::string_view headContent = headFile.view();
+
+    // The path and hash lines come first, the rest is the content byte for byte
+    size_t pathEnd = headContent.find('\n');
+    size_t hashEnd = pathEnd == std::string_view::npos ? pathEnd : headContent.find('\n', pathEnd + 1);
+
+    if(hashEnd == std::string_view::npos){
+        return false;
+    }
+
+    hash = std::string(headContent.substr(pathEnd + 1, hashEnd - pathEnd - 1));
+    content = std::string(headContent.substr(hashEnd + 1));
+
+    return true;
+}
+
+// Function for writing a file's next newest version to its staged path, where it waits to be renamed over the head
+// filePath -> path to the file
+// hash -> hash of the content
+// content -> the new newest version
+static void writeStagedHead(const std::string& filePath, const std::string& hash, const std::string& content){
+    std::filesystem::create_directories(HEAD_DIR_PATH);
+
+    std::ofstream headFile(getStagedHeadPath(filePath), std::ios::binary);
+    headFile << filePath << '\n' << hash << '\n';
+    headFile.write(content.data(), content.size());
+    headFile.close();
+}
+
+// Function for applying a reverse delta to a version of a file, giving the version before it
+// Returns false if there was no version before it
+// reverseDelta -> lines of the reverse delta
+// content -> the version to apply it to, set to the version before it
+static bool applyReverseDelta(const LineTable& reverseDelta, std::string& content){
+    if(reverseDelta.empty() || reverseDelta[0] == REVERSE_NEW_MARKER){
+        content = "";
+        return false;
+    }
+
+    if(reverseDelta[0] == CHUNKED_ENTRY_MARKER){
+        std::vector<std::string> chunkHashes;
+
+        for(size_t i=1; i<reverseDelta.size(); i++){
+            chunkHashes.push_back(std::string(reverseDelta[i]));
+        }
+
+        content = loadChunks(".cupy/chunks", chunkHashes);
+
+        return true;
+    }
+
+    // "#lines <count>"
+    size_t lineCount = parseLineNumber(reverseDelta[0].substr(std::string_view(REVERSE_LINES_MARKER).size() + 1));
+
+    // Lines point into the content, and changed lines are copied into the table's arena
+    LineTable lines(content);
+
+    lines.resize(lineCount);
+
+    for(size_t i=1; i<reverseDelta.size(); i++){
+        std::string_view change = reverseDelta[i];
+
+        size_t splitPos = change.find_first_of(':');
+        size_t lineNum = parseLineNumber(change);
+
+        // Changes past the end are lines the newer version added
+        if(lineNum >= 1 && lineNum <= lineCount){
+            lines.set(lineNum - 1, change.substr(splitPos + 1));
+        }
+    }
+
+    content = reconstructSplitString(lines);
+
+    return true;
+}
+
+// Function for reading a file's reverse delta from a save
+// Returns false if the save doesn't have an entry for the file
+// saveID -> the save to read from
+// filePath -> path to the file
+// reverseDelta -> set to the lines of the reverse delta
+static bool readReverseDelta(int saveID, const std::string& filePath, LineTable& reverseDelta){
+    MappedFile changesFile(".cupy/saves/" + std::to_string(saveID) + "/.changes");
+    LineReader changesLines(changesFile.view());
+
+    std::string entryHeader = '[' + filePath;
+
+    std::string_view line;
+    while(changesLines.next(line)){
+        if(line != entryHeader){
+            continue;
+        }
+
+        // Ignore hash
+        changesLines.next(line);
+
+        reverseDelta.clear();
+
+        while(changesLines.next(line) && line != "--------------------"){
+            reverseDelta.push_back(line);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void enableReverseStorage(std::string directory){
+    std::ofstream storageFile(directory + "/" + STORAGE_MODE_PATH);
+    storageFile << STORAGE_MODE_REVERSE << std::endl;
+}
+
+bool isReverseStorage(){
+    // The mode never changes once a project is set up, so it's only read once
+    static bool reverseStorage = [](){
+        std::ifstream storageFile(STORAGE_MODE_PATH);
+
+        std::string mode;
+        std::getline(storageFile, mode);
+
+        return mode == STORAGE_MODE_REVERSE;
+    }();
+
+    return reverseStorage;
+}
+
+bool readHeadHash(std::string filePath, std::string& hash){
+    std::ifstream headFile(getHeadPath(filePath), std::ios::binary);
+
+    std::string storedPath;
+    return headFile && std::getline(headFile, storedPath) && std::getline(headFile, hash);
+}
+
+std::string rebuildFromHead(const Repository& repo, std::string filePath, int saveIDFinal, bool* existed){
+    TRACE_SPAN("rebuildFromHead", TRACE_REBUILD, filePath);
+    std::string hash;
+    std::string content;
+
+    bool exists = saveIDFinal >= 0 && readHead(filePath, hash, content);
+
+    if(exists){
+        // Walk back from the newest save, undoing every save after saveIDFinal that changed the file
+        // The one table is cleared and reused for each save's reverse delta
+        LineTable reverseDelta;
+
+        refreshSaveFilters();
+
+        for(auto saveIDIter = repo.saveIDs.rbegin(); saveIDIter != repo.saveIDs.rend() && *saveIDIter > saveIDFinal; saveIDIter++){
+            int saveID = *saveIDIter;
+
+            // Saves that certainly don't have an entry for the file are skipped without opening their .changes
+            if(!saveMayTouch(saveID, filePath)){
+                continue;
+            }
+
+            if(readReverseDelta(saveID, filePath, reverseDelta) && !applyReverseDelta(reverseDelta, content)){
+                exists = false;
+                break;
+            }
+        }
+    }
+
+    if(!exists){
+        content = "";
+    }
+
+    if(existed != nullptr){
+        *existed = exists;
+    }
+
+    return content;
+}
+
+void saveReverseEntry(std::ostream& changesFile, std::string filePath, const std::string& content, const std::string& hash){
+    TRACE_SPAN("saveReverseEntry", TRACE_IO, filePath);
+    std::string oldHash;
+    std::string oldContent;
+
+    bool hadHead = readHead(filePath, oldHash, oldContent);
+
+    changesFile << '[' << filePath << std::endl;
+    changesFile << hash << std::endl;
+
+    if(!hadHead){
+        changesFile << REVERSE_NEW_MARKER << std::endl;
+
+    }else if(isChunkedContent(oldContent) || isChunkedContent(content)){
+        // Line changes can't describe large or binary files, so keep the older version in full as chunks
+        int newChunkCount = 0;
+        std::vector<std::string> chunkHashes = storeChunks(".cupy/chunks", oldContent, &newChunkCount);
+
+        changesFile << CHUNKED_ENTRY_MARKER << std::endl;
+
+        for(const std::string& chunkHash : chunkHashes){
+            changesFile << chunkHash << std::endl;
+        }
+
+        log("[" + filePath + "] stored " + std::to_string(newChunkCount) + " new chunk(s) of " + std::to_string(chunkHashes.size()) + " for the previous version");
+
+    }else{
+        // Every newline starts another line, even at the very end, so joining the lines back together gives the
+        // content byte for byte (splitting like getline would lose a final newline)
+        size_t oldLineCount = oldContent.empty() ? 0 : std::count(oldContent.begin(), oldContent.end(), '\n') + 1;
+
+        changesFile << REVERSE_LINES_MARKER << ' ' << oldLineCount << std::endl;
+
+        // getChanges gives back every line of the first version when the second is empty, nothing is needed then
+        if(!oldContent.empty()){
+            for(std::string_view change : getChanges(content, oldContent)){
+                changesFile << change << std::endl;
+            }
+        }
+
+        for(std::string_view change : getChanges(oldContent, content)){
+            size_t splitPos = change.find_first_of(':');
+
+            log("[" + filePath + "]" + std::string(change.substr(0, splitPos)) + " => " + std::string(change.substr(splitPos + 1)));
+        }
+    }
+
+    changesFile << "--------------------" << std::endl;
+
+    writeStagedHead(filePath, hash, content);
+}
+
+void commitStagedHeads(const std::vector<std::string>& filePaths){
+    for(const std::string& filePath : filePaths){
+        std::filesystem::rename(getStagedHeadPath(filePath), getHeadPath(filePath));
+    }
+}
+
+void rewindHeads(const Repository& repo, int saveID){
+    TRACE_SPAN("rewindHeads", TRACE_REBUILD);
+
+    if(!std::filesystem::exists(HEAD_DIR_PATH)){
+        return;
+    }
+
+    std::vector<std::string> filePaths;
+
+    for(auto headFile : std::filesystem::directory_iterator(HEAD_DIR_PATH)){
+        // Heads left staged by a save that never finished aren't part of the project
+        if(headFile.path().has_extension()){
+            continue;
+        }
+
+        std::ifstream headStream(headFile.path(), std::ios::binary);
+
+        std::string filePath;
+        if(std::getline(headStream, filePath)){
+            filePaths.push_back(filePath);
+        }
+    }
+
+    for(const std::string& filePath : filePaths){
+        bool existed = false;
+        std::string content = rebuildFromHead(repo, filePath, saveID, &existed);
+
+        if(existed){
+            // Staged and renamed, so a head is never half written
+            writeStagedHead(filePath, hashStoredContent(content), content);
+            commitStagedHeads({filePath});
+        }else{
+            std::filesystem::remove(getHeadPath(filePath));
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef REVERSEDELTAS_H
+#define REVERSEDELTAS_H
+
+#include <string>
+#include <ostream>
+#include <vector>
+
+#include "repository.h"
+
+// File that holds the project's storage mode, only present for projects using reverse deltas
+#define STORAGE_MODE_PATH ".cupy/storage"
+#define STORAGE_MODE_REVERSE "reverse"
+
+// Directory holding the newest saved version of each file, for projects using reverse deltas
+#define HEAD_DIR_PATH ".cupy/head"
+
+// Added to a head's path for the version a save in progress will make the newest
+#define HEAD_STAGED_SUFFIX ".staged"
+
+// First line of a reverse delta for a file that didn't exist before the save
+#define REVERSE_NEW_MARKER "#new"
+
+// First line of a reverse delta made of line changes, followed by how many lines the older version has
+#define REVERSE_LINES_MARKER "#lines"
+
+// With reverse deltas the newest version of every file is kept whole in HEAD_DIR_PATH, and each .changes entry
+// holds the hash of the file at that save followed by how to get back to the version before it:
+//   #new                    -> the file wasn't saved before
+//   #lines <count>, N:line  -> the older version has <count> lines (one more than its newlines), with these lines different
+//   #chunks, <hashes>       -> the older version in full as chunks (used when either version is large or binary)
+// Reading the newest version is then a single file read, and older versions are rebuilt by walking back from it
+
+// Function for setting up a new project to use reverse deltas
+// directory -> the project directory
+void enableReverseStorage(std::string directory);
+
+// Function for checking if the current project uses reverse deltas
+bool isReverseStorage();
+
+// Function for reading the hash of the newest saved version of a file
+// Returns false if the file has never been saved
+// filePath -> path to the file
+// hash -> set to the hash
+bool readHeadHash(std::string filePath, std::string& hash);
+
+// Function for rebuilding a file as it was at a save by walking back from its newest version
+// Returns "" if the file wasn't saved by then
+// repo -> the project
+// filePath -> path to the file to rebuild
+// saveIDFinal -> the save ID to rebuild up to (and including)
+// existed -> set to false if the file wasn't saved by then (optional)
+std::string rebuildFromHead(const Repository& repo, std::string filePath, int saveIDFinal, bool* existed = nullptr);
+
+// Function for writing a .changes entry for a file into a save and staging its content as the newest version
+// The staged version only replaces the newest one when commitStagedHeads is called, once the save is complete
+// changesFile -> the save's .changes file
+// filePath -> path to the file
+// content -> the file's content, as read by readFileContent
+// hash -> the hash of the content (the command has already worked it out to check if the file changed)
+void saveReverseEntry(std::ostream& changesFile, std::string filePath, const std::string& content, const std::string& hash);
+
+// Function for making the versions staged by saveReverseEntry the newest, once their save is complete
+// filePaths -> paths of the files the save has entries for
+void commitStagedHeads(const std::vector<std::string>& filePaths);
+
+// Function for moving every newest version back to how it was at a save, before the saves after it are removed
+// repo -> the project
+// saveID -> the save to move back to (-1 for before the first save)
+void rewindHeads(const Repository& repo, int saveID);
+
+#endif
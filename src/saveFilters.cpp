@@ -0,0 +1,201 @@
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+
+#include "saveFilters.h"
+#include "trace.h"
+#include "mappedFile.h"
+
+// Filters of every save, loaded together and kept until .cupy/saves changes
+static std::unordered_map<int, BloomFilter> saveFilters;
+static std::filesystem::file_time_type saveFiltersLoadedAt;
+static bool saveFiltersLoaded = false;
+
+// Function for hashing a path into the two hashes the filter's bit positions are made from
+// path -> the path to hash
+// firstHash -> set to the first hash
+// secondHash -> set to the second hash (always odd, so every bit can be reached)
+static void hashPath(const std::string& path, uint64_t& firstHash, uint64_t& secondHash){
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+
+    for(unsigned char c : path){
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    firstHash = hash;
+
+    // splitmix64 finaliser, to get a second hash that doesn't follow the first
+    hash += 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    secondHash = hash | 1;
+}
+
+// Function for getting the path of a save's filter
+// saveID -> the save
+static std::string getSaveFilterPath(int saveID){
+    return ".cupy/saves/" + std::to_string(saveID) + "/" + SAVE_FILTER_FILE;
+}
+
+// Function for reading a save's filter
+// Returns false if the save doesn't have one
+// saveID -> the save
+// filter -> set to the filter
+static bool readSaveFilter(int saveID, BloomFilter& filter){
+    std::ifstream filterFile(getSaveFilterPath(saveID), std::ios::binary);
+
+    uint32_t wordCount = 0;
+
+    if(!filterFile.read(reinterpret_cast<char*>(&filter.hashCount), sizeof(filter.hashCount)) || !filterFile.read(reinterpret_cast<char*>(&wordCount), sizeof(wordCount))){
+        return false;
+    }
+
+    filter.words.resize(wordCount);
+
+    return wordCount > 0 && filterFile.read(reinterpret_cast<char*>(filter.words.data()), wordCount * sizeof(uint64_t));
+}
+
+void refreshSaveFilters(){
+    std::error_code err;
+    std::filesystem::file_time_type savesChangedAt = std::filesystem::last_write_time(".cupy/saves", err);
+
+    if(saveFiltersLoaded && savesChangedAt == saveFiltersLoadedAt){
+        return;
+    }
+
+    TRACE_SPAN("refreshSaveFilters", TRACE_IO);
+
+    saveFilters.clear();
+
+    for(auto saveDir : std::filesystem::directory_iterator(".cupy/saves/", err)){
+        try{
+            int saveID = std::stoi(saveDir.path().filename().string());
+
+            BloomFilter filter;
+
+            if(readSaveFilter(saveID, filter)){
+                saveFilters[saveID] = std::move(filter);
+            }
+
+        }catch(std::invalid_argument& err){
+            // Not a save
+        }
+    }
+
+    saveFiltersLoadedAt = savesChangedAt;
+    saveFiltersLoaded = true;
+}
+
+BloomFilter buildBloomFilter(const std::vector<std::string>& paths){
+    BloomFilter filter;
+    filter.hashCount = BLOOM_HASH_COUNT;
+
+    // At least one word, so an empty save still has a filter
+    size_t bitCount = std::max<size_t>(64, paths.size() * BLOOM_BITS_PER_PATH);
+    filter.words.assign((bitCount + 63) / 64, 0);
+
+    bitCount = filter.words.size() * 64;
+
+    for(const std::string& path : paths){
+        uint64_t firstHash;
+        uint64_t secondHash;
+        hashPath(path, firstHash, secondHash);
+
+        for(uint32_t i=0; i<filter.hashCount; i++){
+            uint64_t bit = (firstHash + i * secondHash) % bitCount;
+            filter.words[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    return filter;
+}
+
+bool bloomMayContain(const BloomFilter& filter, const std::string& path){
+    uint64_t bitCount = filter.words.size() * 64;
+
+    uint64_t firstHash;
+    uint64_t secondHash;
+    hashPath(path, firstHash, secondHash);
+
+    for(uint32_t i=0; i<filter.hashCount; i++){
+        uint64_t bit = (firstHash + i * secondHash) % bitCount;
+
+        if((filter.words[bit / 64] & (1ULL << (bit % 64))) == 0){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void writeSaveFilter(int saveID, const std::vector<std::string>& paths){
+    BloomFilter filter = buildBloomFilter(paths);
+    uint32_t wordCount = filter.words.size();
+
+    std::string filterPath = getSaveFilterPath(saveID);
+
+    // Written next to it and renamed, so a half written filter is never read
+    std::ofstream filterFile(filterPath + ".tmp", std::ios::binary);
+    filterFile.write(reinterpret_cast<const char*>(&filter.hashCount), sizeof(filter.hashCount));
+    filterFile.write(reinterpret_cast<const char*>(&wordCount), sizeof(wordCount));
+    filterFile.write(reinterpret_cast<const char*>(filter.words.data()), wordCount * sizeof(uint64_t));
+    filterFile.close();
+
+    std::filesystem::rename(filterPath + ".tmp", filterPath);
+
+    if(saveFiltersLoaded){
+        saveFilters[saveID] = std::move(filter);
+    }
+}
+
+void writeMissingSaveFilters(){
+    std::error_code err;
+
+    for(auto saveDir : std::filesystem::directory_iterator(".cupy/saves/", err)){
+        int saveID;
+
+        try{
+            saveID = std::stoi(saveDir.path().filename().string());
+        }catch(std::invalid_argument& err){
+            continue;
+        }
+
+        if(std::filesystem::exists(getSaveFilterPath(saveID))){
+            continue;
+        }
+
+        MappedFile changesFile(saveDir.path().string() + "/.changes");
+        LineReader changesLines(changesFile.view());
+        std::vector<std::string> paths;
+
+        // Content lines starting with [ get added too, which only costs a few more false positives
+        std::string_view line;
+        while(changesLines.next(line)){
+            if(!line.empty() && line[0] == '['){
+                paths.push_back(std::string(line.substr(1)));
+            }
+        }
+
+        writeSaveFilter(saveID, paths);
+    }
+}
+
+bool saveMayTouch(int saveID, const std::string& filePath){
+    if(!saveFiltersLoaded){
+        refreshSaveFilters();
+    }
+
+    auto found = saveFilters.find(saveID);
+
+    if(found == saveFilters.end()){
+        return true;
+    }
+
+    return bloomMayContain(found->second, filePath);
+}
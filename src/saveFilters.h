@@ -0,0 +1,49 @@
+#ifndef SAVEFILTERS_H
+#define SAVEFILTERS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// File in each save directory holding a Bloom filter of the paths the save has entries for
+#define SAVE_FILTER_FILE ".filter"
+
+// Bits per path and hashes per lookup, giving about a 1% false positive rate
+#define BLOOM_BITS_PER_PATH 10
+#define BLOOM_HASH_COUNT 7
+
+// Struct for storing a Bloom filter of paths
+struct BloomFilter{
+    uint32_t hashCount;
+    std::vector<uint64_t> words;
+};
+
+// Function for building a Bloom filter holding some paths
+// paths -> the paths to add
+BloomFilter buildBloomFilter(const std::vector<std::string>& paths);
+
+// Function for checking if a path might be in a Bloom filter (false means it certainly isn't)
+// filter -> the filter to check
+// path -> the path to look for
+bool bloomMayContain(const BloomFilter& filter, const std::string& path);
+
+// Function for writing the filter of a save once its .changes has been written
+// saveID -> the save
+// paths -> the paths the save has entries for
+void writeSaveFilter(int saveID, const std::vector<std::string>& paths);
+
+// Function for writing filters for any saves that don't have one yet (saves made before filters existed)
+// Only call this while no save is being written, as it reads each save's .changes as it is
+void writeMissingSaveFilters();
+
+// Function for loading every save's filter, if they haven't been loaded since .cupy/saves last changed
+// Call before a run of saveMayTouch lookups, so changes made by other commands (or this one) are picked up
+void refreshSaveFilters();
+
+// Function for checking if a save might have an entry for a path, so saves that don't can be skipped without
+// opening their .changes (saves without a filter always might)
+// saveID -> the save
+// filePath -> the path to look for
+bool saveMayTouch(int saveID, const std::string& filePath);
+
+#endif
@@ -0,0 +1,520 @@
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <deque>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "storageIO.h"
+#include "workQueue.h"
+#include "trace.h"
+
+#if defined(__linux__) && !defined(CVCS_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+
+    // Plain reads and writes (IORING_OP_READ/WRITE) came in the same kernel as this feature
+    #ifdef IORING_FEAT_RW_CUR_POS
+        #define STORAGE_IO_URING
+    #endif
+#endif
+
+// Largest single read or write handed to the kernel (longer ones carry on where they stopped)
+#define STORAGE_IO_MAX_REQUEST ((size_t)1 << 30)
+
+// Struct for storing a read or write of one file in a batch
+struct StorageRequest{
+    int fileFD;
+
+    // Where the next byte is read into or written from, and how many are left
+    char* data;
+    size_t length;
+
+    // Where in the file the next byte is, which for reads ends up as how much was read
+    off_t offset;
+
+    bool write;
+
+    // Position of the file in the batch
+    size_t fileIndex;
+};
+
+// Function for moving a request on by the result of a read or write
+// Returns true once the request is done
+// Throws runtime_error if the read or write failed
+// request -> the request
+// result -> bytes read or written, or minus the error number
+static bool advanceRequest(StorageRequest& request, long result){
+    if(result == -EINTR || result == -EAGAIN){
+        // Try again
+        return false;
+    }
+
+    if(result < 0){
+        throw std::runtime_error(std::string(request.write ? "Write" : "Read") + " failed: " + std::strerror(-result));
+    }
+
+    if(result == 0){
+        if(request.write){
+            throw std::runtime_error("Write failed: nothing was written");
+        }
+
+        // The file got shorter since it was opened
+        request.length = 0;
+        return true;
+    }
+
+    request.data += result;
+    request.length -= result;
+    request.offset += result;
+
+    return request.length == 0;
+}
+
+// Struct for storing a batch being run by the thread pool
+struct PoolBatch{
+    std::mutex mutex;
+    std::condition_variable done;
+
+    size_t remaining;
+
+    // First thing to fail, rethrown once the whole batch has finished
+    std::exception_ptr failure;
+};
+
+// Struct for storing a request handed to the thread pool
+struct PoolTask{
+    StorageRequest* request;
+    PoolBatch* batch;
+};
+
+// Function for getting the queue of the thread pool, starting its threads the first time
+static BoundedQueue<PoolTask>& getPoolQueue(){
+    // Never freed, as the threads wait on it for as long as the process runs
+    static BoundedQueue<PoolTask>* queue = new BoundedQueue<PoolTask>(STORAGE_IO_QUEUE_DEPTH);
+    static std::once_flag started;
+
+    std::call_once(started, [](){
+        for(int i=0; i<STORAGE_IO_THREADS; i++){
+            std::thread([](){
+                PoolTask task;
+
+                while(queue->pop(task)){
+                    StorageRequest& request = *task.request;
+                    std::exception_ptr failure = nullptr;
+
+                    try{
+                        bool finished = false;
+
+                        while(!finished){
+                            size_t length = std::min(request.length, STORAGE_IO_MAX_REQUEST);
+
+                            ssize_t result = request.write ? pwrite(request.fileFD, request.data, length, request.offset) : pread(request.fileFD, request.data, length, request.offset);
+
+                            finished = advanceRequest(request, result < 0 ? -errno : result);
+                        }
+
+                    }catch(...){
+                        failure = std::current_exception();
+                    }
+
+                    std::lock_guard<std::mutex> lock(task.batch->mutex);
+
+                    if(failure && !task.batch->failure){
+                        task.batch->failure = failure;
+                    }
+
+                    task.batch->remaining--;
+                    task.batch->done.notify_all();
+                }
+            }).detach();
+        }
+    });
+
+    return *queue;
+}
+
+// Function for running a batch of requests on the thread pool, waiting for all of them
+// requests -> the requests to run
+static void runWithThreads(std::vector<StorageRequest>& requests){
+    BoundedQueue<PoolTask>& queue = getPoolQueue();
+
+    PoolBatch batch;
+    batch.remaining = requests.size();
+    batch.failure = nullptr;
+
+    for(StorageRequest& request : requests){
+        queue.push({&request, &batch});
+    }
+
+    std::unique_lock<std::mutex> lock(batch.mutex);
+
+    batch.done.wait(lock, [&batch](){
+        return batch.remaining == 0;
+    });
+
+    if(batch.failure){
+        std::rethrow_exception(batch.failure);
+    }
+}
+
+#ifdef STORAGE_IO_URING
+
+// An io_uring instance, set up with raw system calls (so liburing isn't needed)
+// Requests go on the submission ring and the kernel puts their results on the completion ring, so one thread can
+// keep a whole batch in flight at once
+class IoUring{
+public:
+    // Sets the ring up, check isAvailable() before using it
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Function for checking if the kernel let the ring be set up
+    bool isAvailable() const;
+
+    // Function for running a batch of requests, waiting for all of them
+    // Throws runtime_error if one fails (once the rest have finished, as they point into the caller's buffers)
+    // requests -> the requests to run
+    void run(std::vector<StorageRequest>& requests);
+
+private:
+    // Function for unmapping the rings and closing the ring
+    void tearDown();
+
+    int ringFD;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* sqArray;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+};
+
+IoUring::IoUring() : ringFD(-1), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0), sqes((io_uring_sqe*)MAP_FAILED), sqesSize(0){
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ringFD = syscall(__NR_io_uring_setup, STORAGE_IO_QUEUE_DEPTH, &params);
+
+    if(ringFD < 0){
+        // Not supported, or not allowed (such as by a seccomp filter or io_uring_disabled)
+        ringFD = -1;
+        return;
+    }
+
+    if(!(params.features & IORING_FEAT_RW_CUR_POS)){
+        // Kernel too old for plain reads and writes
+        tearDown();
+        return;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+
+    if(singleMap){
+        sqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQ_RING);
+
+    if(sqRing == MAP_FAILED){
+        tearDown();
+        return;
+    }
+
+    if(!singleMap){
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_CQ_RING);
+
+        if(cqRing == MAP_FAILED){
+            tearDown();
+            return;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQES);
+
+    if(sqes == MAP_FAILED){
+        tearDown();
+        return;
+    }
+
+    char* sq = (char*)sqRing;
+    char* cq = singleMap ? sq : (char*)cqRing;
+
+    sqHead = (unsigned*)(sq + params.sq_off.head);
+    sqTail = (unsigned*)(sq + params.sq_off.tail);
+    sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqArray = (unsigned*)(sq + params.sq_off.array);
+
+    cqHead = (unsigned*)(cq + params.cq_off.head);
+    cqTail = (unsigned*)(cq + params.cq_off.tail);
+    cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring(){
+    tearDown();
+}
+
+void IoUring::tearDown(){
+    if(sqes != MAP_FAILED){
+        munmap(sqes, sqesSize);
+        sqes = (io_uring_sqe*)MAP_FAILED;
+    }
+
+    if(cqRing != MAP_FAILED){
+        munmap(cqRing, cqRingSize);
+        cqRing = MAP_FAILED;
+    }
+
+    if(sqRing != MAP_FAILED){
+        munmap(sqRing, sqRingSize);
+        sqRing = MAP_FAILED;
+    }
+
+    if(ringFD >= 0){
+        close(ringFD);
+        ringFD = -1;
+    }
+}
+
+bool IoUring::isAvailable() const{
+    return ringFD >= 0;
+}
+
+void IoUring::run(std::vector<StorageRequest>& requests){
+    // Requests waiting to be submitted, by index (requests that stopped part way through go back on the end)
+    std::deque<size_t> waiting;
+
+    for(size_t i=0; i<requests.size(); i++){
+        waiting.push_back(i);
+    }
+
+    size_t inFlight = 0;
+    std::string failure = "";
+
+    while(inFlight > 0 || (!waiting.empty() && failure == "")){
+        // Fill the submission ring, nothing else adds to it so the tail can be read plainly
+        unsigned tail = *sqTail;
+
+        while(!waiting.empty() && failure == "" && inFlight < sqEntries){
+            size_t requestIndex = waiting.front();
+            waiting.pop_front();
+
+            StorageRequest& request = requests[requestIndex];
+
+            io_uring_sqe* sqe = &sqes[tail & sqMask];
+            std::memset(sqe, 0, sizeof(io_uring_sqe));
+
+            sqe->opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd = request.fileFD;
+            sqe->addr = (uint64_t)(uintptr_t)request.data;
+            sqe->len = (unsigned)std::min(request.length, STORAGE_IO_MAX_REQUEST);
+            sqe->off = request.offset;
+            sqe->user_data = requestIndex;
+
+            sqArray[tail & sqMask] = tail & sqMask;
+            tail++;
+
+            inFlight++;
+        }
+
+        // Make the new entries visible to the kernel before telling it about them
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        unsigned toSubmit = tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+        int entered;
+        {
+            TRACE_SPAN("io_uring_enter", TRACE_IO);
+            entered = syscall(__NR_io_uring_enter, ringFD, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        }
+
+        if(entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY){
+            if(failure == ""){
+                failure = std::string("io_uring_enter failed: ") + std::strerror(errno);
+            }
+
+            // Entries the kernel didn't take point into the caller's buffers, which are freed once this throws, so
+            // take them back out of the ring rather than leave them for the thread's next batch to submit
+            unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+
+            // Only what the kernel already has is still in flight, once that has come back the failure is thrown
+            inFlight -= tail - head;
+        }
+
+        // Take every result that's ready
+        unsigned head = *cqHead;
+
+        while(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)){
+            io_uring_cqe* cqe = &cqes[head & cqMask];
+            StorageRequest& request = requests[cqe->user_data];
+            long result = cqe->res;
+
+            head++;
+            inFlight--;
+
+            try{
+                if(!advanceRequest(request, result)){
+                    waiting.push_back(cqe->user_data);
+                }
+
+            }catch(std::runtime_error& err){
+                if(failure == ""){
+                    failure = err.what();
+                }
+            }
+        }
+
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    if(failure != ""){
+        throw std::runtime_error(failure);
+    }
+}
+
+// Function for getting the calling thread's ring, setting it up the first time
+// Each thread has its own, so batches from different threads never wait on each other
+static IoUring& getRing(){
+    thread_local IoUring ring;
+    return ring;
+}
+
+#endif
+
+// Function for running a batch of requests through whichever backend is available, waiting for all of them
+// requests -> the requests to run
+static void runRequests(std::vector<StorageRequest>& requests){
+    if(requests.empty()){
+        return;
+    }
+
+#ifdef STORAGE_IO_URING
+    IoUring& ring = getRing();
+
+    if(ring.isAvailable()){
+        ring.run(requests);
+        return;
+    }
+#endif
+
+    runWithThreads(requests);
+}
+
+// Function for closing the files of a batch
+// fileFDs -> the files (-1 for ones that weren't opened)
+static void closeFiles(const std::vector<int>& fileFDs){
+    for(int fileFD : fileFDs){
+        if(fileFD >= 0){
+            close(fileFD);
+        }
+    }
+}
+
+std::vector<std::string> readStoredFiles(const std::vector<std::string>& filePaths){
+    TRACE_SPAN("readStoredFiles", TRACE_IO, std::to_string(filePaths.size()) + " files");
+    std::vector<std::string> contents(filePaths.size());
+    std::vector<int> fileFDs(filePaths.size(), -1);
+    std::vector<StorageRequest> requests;
+
+    for(size_t i=0; i<filePaths.size(); i++){
+        fileFDs[i] = open(filePaths[i].c_str(), O_RDONLY | O_CLOEXEC);
+
+        struct stat fileStat;
+
+        if(fileFDs[i] < 0 || fstat(fileFDs[i], &fileStat) != 0 || fileStat.st_size <= 0){
+            continue;
+        }
+
+        contents[i].resize(fileStat.st_size);
+        requests.push_back({fileFDs[i], &contents[i][0], contents[i].size(), 0, false, i});
+    }
+
+    try{
+        runRequests(requests);
+
+    }catch(...){
+        closeFiles(fileFDs);
+        throw;
+    }
+
+    closeFiles(fileFDs);
+
+    // A file that got shorter since it was opened only has what was read
+    for(const StorageRequest& request : requests){
+        contents[request.fileIndex].resize(request.offset);
+    }
+
+    return contents;
+}
+
+void writeStoredFiles(const std::vector<StorageWrite>& writes){
+    TRACE_SPAN("writeStoredFiles", TRACE_IO, std::to_string(writes.size()) + " files");
+    std::vector<int> fileFDs(writes.size(), -1);
+    std::vector<StorageRequest> requests;
+
+    for(size_t i=0; i<writes.size(); i++){
+        fileFDs[i] = open(writes[i].path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+        if(fileFDs[i] < 0){
+            std::string reason = std::strerror(errno);
+            closeFiles(fileFDs);
+
+            throw std::runtime_error("Couldn't open " + writes[i].path + " for writing: " + reason);
+        }
+
+        if(!writes[i].content.empty()){
+            requests.push_back({fileFDs[i], const_cast<char*>(writes[i].content.data()), writes[i].content.size(), 0, true, i});
+        }
+    }
+
+    try{
+        runRequests(requests);
+
+    }catch(...){
+        closeFiles(fileFDs);
+        throw;
+    }
+
+    closeFiles(fileFDs);
+}
+
+const char* getStorageBackendName(){
+#ifdef STORAGE_IO_URING
+    if(getRing().isAvailable()){
+        return "io_uring";
+    }
+#endif
+
+    return "threads";
+}
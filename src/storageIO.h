@@ -0,0 +1,34 @@
+#ifndef STORAGEIO_H
+#define STORAGEIO_H
+
+#include <string>
+#include <vector>
+
+// Most reads and writes the io_uring backend keeps in flight at once (per thread using it)
+#define STORAGE_IO_QUEUE_DEPTH 64
+
+// Threads the fallback backend uses for reads and writes, shared by every thread using it
+#define STORAGE_IO_THREADS 8
+
+// Struct for storing a whole file to write
+struct StorageWrite{
+    std::string path;
+    std::string content;
+};
+
+// Function for reading several whole files at once
+// The reads are all handed to the kernel together (through io_uring where it's available, otherwise through a small
+// pool of threads), so a batch takes about as long as its slowest file rather than the sum of them
+// Returns the contents in the same order as the paths, a file that can't be opened gives "" (like an ifstream would)
+// filePaths -> paths of the files to read
+std::vector<std::string> readStoredFiles(const std::vector<std::string>& filePaths);
+
+// Function for writing several whole files at once, each created or replaced
+// Throws runtime_error if a file can't be written
+// writes -> the files to write
+void writeStoredFiles(const std::vector<StorageWrite>& writes);
+
+// Function for getting the name of the backend reads and writes go through ("io_uring" or "threads")
+const char* getStorageBackendName();
+
+#endif
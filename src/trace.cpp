@@ -0,0 +1,152 @@
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "trace.h"
+
+std::atomic<bool> tracingEnabled{false};
+
+// Struct for storing a finished span
+struct TraceEvent{
+    const char* name;
+    const char* category;
+    std::string detail;
+    long long start;
+    long long end;
+};
+
+// Spans recorded by one thread
+// Each thread appends to its own buffer, so threads only share the lock with stopTracing
+struct ThreadTraceBuffer{
+    std::mutex mutex;
+    int threadID;
+    std::vector<TraceEvent> events;
+};
+
+// Buffers are kept until the trace is written, even after their thread has finished
+static std::mutex traceMutex;
+static std::vector<ThreadTraceBuffer*> threadBuffers;
+static std::string traceFilePath = "";
+
+thread_local ThreadTraceBuffer* threadBuffer = nullptr;
+
+long long getTraceTime(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void startTracing(std::string tracePath){
+    std::lock_guard<std::mutex> lock(traceMutex);
+
+    traceFilePath = tracePath;
+    tracingEnabled.store(true);
+}
+
+void recordSpan(const char* name, const char* category, std::string detail, long long start, long long end){
+    if(threadBuffer == nullptr){
+        std::lock_guard<std::mutex> lock(traceMutex);
+
+        threadBuffer = new ThreadTraceBuffer();
+        threadBuffer->threadID = threadBuffers.size() + 1;
+
+        threadBuffers.push_back(threadBuffer);
+    }
+
+    std::lock_guard<std::mutex> lock(threadBuffer->mutex);
+    threadBuffer->events.push_back({name, category, std::move(detail), start, end});
+}
+
+std::string escapeJson(const std::string& text){
+    std::string escaped;
+
+    for(char c : text){
+        if(c == '"' || c == '\\'){
+            escaped += '\\';
+            escaped += c;
+        }else if(static_cast<unsigned char>(c) < 0x20){
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            escaped += buffer;
+        }else{
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+void stopTracing(){
+    if(!tracingEnabled.exchange(false)){
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+
+    // Timestamps are written relative to the earliest span so the viewer starts at zero
+    long long firstStart = -1;
+
+    for(ThreadTraceBuffer* buffer : threadBuffers){
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+
+        for(TraceEvent& event : buffer->events){
+            if(firstStart < 0 || event.start < firstStart){
+                firstStart = event.start;
+            }
+        }
+    }
+
+    std::ofstream traceFile(traceFilePath);
+    traceFile << "{\"traceEvents\":[\n";
+
+    bool firstEvent = true;
+
+    for(ThreadTraceBuffer* buffer : threadBuffers){
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+
+        for(TraceEvent& event : buffer->events){
+            char timing[96];
+            std::snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f", (event.start - firstStart) / 1000.0, (event.end - event.start) / 1000.0);
+
+            traceFile << (firstEvent ? "" : ",\n");
+            traceFile << "{\"name\":\"" << escapeJson(event.name) << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\"," << timing;
+            traceFile << ",\"pid\":1,\"tid\":" << buffer->threadID;
+
+            if(!event.detail.empty()){
+                traceFile << ",\"args\":{\"detail\":\"" << escapeJson(event.detail) << "\"}";
+            }
+
+            traceFile << "}";
+
+            firstEvent = false;
+        }
+
+        buffer->events.clear();
+    }
+
+    traceFile << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    traceFile.close();
+}
+
+void startTracingFromArguments(int& argc, char* argv[]){
+    for(int i=1; i<argc-1; i++){
+        if(std::strcmp(argv[i], "--trace") != 0){
+            continue;
+        }
+
+        startTracing(argv[i+1]);
+
+        // Shift the rest of the arguments down over the option
+        for(int j=i; j+2<=argc; j++){
+            argv[j] = argv[j+2];
+        }
+
+        argc -= 2;
+
+        std::atexit(stopTracing);
+
+        return;
+    }
+}
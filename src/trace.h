@@ -0,0 +1,93 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <atomic>
+
+// Span categories, shown as the "cat" of each event in the trace viewer
+#define TRACE_COMMAND "command"
+#define TRACE_REBUILD "rebuild"
+#define TRACE_HASH "hash"
+#define TRACE_DIFF "diff"
+#define TRACE_IO "io"
+#define TRACE_NET "net"
+
+// Whether spans are being recorded, checked by every span so a disabled span only costs a load and a branch
+extern std::atomic<bool> tracingEnabled;
+
+// Function for starting to record spans
+// tracePath -> file the trace is written to by stopTracing
+void startTracing(std::string tracePath);
+
+// Function for stopping tracing and writing every recorded span to the trace file, in Chrome trace-event format
+// (opens in chrome://tracing, Perfetto and speedscope)
+void stopTracing();
+
+// Function for taking a "--trace <file>" option out of the command line and starting tracing if it was there
+// The trace is written when the program exits, and the rest of argv is shifted down so it parses as before
+// argc -> argument count, reduced if the option was found
+// argv -> arguments
+void startTracingFromArguments(int& argc, char* argv[]);
+
+// Function for getting the time used for spans, in nanoseconds
+long long getTraceTime();
+
+// Function for escaping a string for use in JSON (trace events and the server's metrics)
+// text -> the string to escape
+std::string escapeJson(const std::string& text);
+
+// Function for recording a finished span (called by TraceSpan)
+void recordSpan(const char* name, const char* category, std::string detail, long long start, long long end);
+
+// Times the scope it's created in and records it as a span if tracing is on
+// name and category must be string literals (they're kept by pointer)
+class TraceSpan{
+public:
+    TraceSpan(const char* name, const char* category) : name(name), category(category), active(tracingEnabled.load(std::memory_order_relaxed)){
+        if(active){
+            start = getTraceTime();
+        }
+    }
+
+    ~TraceSpan(){
+        if(active){
+            recordSpan(name, category, std::move(detail), start, getTraceTime());
+        }
+    }
+
+    bool isActive() const{
+        return active;
+    }
+
+    // Function for setting the text shown with the span, only called by TRACE_SPAN when tracing is on
+    // detail -> text to show
+    void setDetail(const std::string& detail){
+        this->detail = detail;
+    }
+
+    void setDetail(){}
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    std::string detail;
+    long long start = 0;
+    bool active;
+};
+
+// TRACE_SPAN(name, category) or TRACE_SPAN(name, category, detail), the detail expression is only evaluated when
+// tracing is on so building it costs nothing otherwise
+// Builds with -DCVCS_NO_TRACE leave spans out completely
+#ifdef CVCS_NO_TRACE
+    #define TRACE_SPAN(...)
+#else
+    #define TRACE_CONCAT_INNER(a, b) a##b
+    #define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+    #define TRACE_SPAN(name, category, ...) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name, category); \
+        if(TRACE_CONCAT(traceSpan, __LINE__).isActive()) TRACE_CONCAT(traceSpan, __LINE__).setDetail(__VA_ARGS__)
+#endif
+
+#endif
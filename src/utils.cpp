@@ -3,8 +3,13 @@
 #include <ctime>
 #include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <charconv>
 
 #include "utils.h"
+#include "chunker.h"
+#include "trace.h"
+#include "mappedFile.h"
 
 std::string getDateTime(){
     time_t ts;
@@ -13,11 +18,45 @@ std::string getDateTime(){
     return ctime(&ts);
 }
 
-std::string reconstructSplitString(std::vector<std::string> splitString){
+std::string reconstructSplitString(const std::vector<std::string>& splitString){
+    TRACE_SPAN("reconstructSplitString", TRACE_DIFF);
     std::string reconstructed = "";
 
-    for(std::string line : splitString){
-        reconstructed += line + "\n";
+    // Size it once up front rather than growing it line by line
+    size_t totalSize = 0;
+    for(const std::string& line : splitString){
+        totalSize += line.size() + 1;
+    }
+
+    reconstructed.reserve(totalSize);
+
+    for(const std::string& line : splitString){
+        reconstructed += line;
+        reconstructed += '\n';
+    }
+
+    if(reconstructed.size() > 0){
+        // Remove extra newline
+        reconstructed.pop_back();
+    }
+
+    return reconstructed;
+}
+
+std::string reconstructSplitString(const LineTable& lines){
+    TRACE_SPAN("reconstructSplitString", TRACE_DIFF);
+    std::string reconstructed = "";
+
+    size_t totalSize = 0;
+    for(std::string_view line : lines){
+        totalSize += line.size() + 1;
+    }
+
+    reconstructed.reserve(totalSize);
+
+    for(std::string_view line : lines){
+        reconstructed += line;
+        reconstructed += '\n';
     }
 
     if(reconstructed.size() > 0){
@@ -32,20 +71,54 @@ bool doesFileExist(std::string filePath){
     return std::filesystem::exists(filePath);
 }
 
-std::vector<std::string> getChanges(std::string file1Contents, std::string file2Contents){
-    std::vector<std::string> changes = {};
+std::string readFileContent(std::string filePath){
+    TRACE_SPAN("readFileContent", TRACE_IO, filePath);
+    MappedFile file(filePath);
+
+    return std::string(getStoredContent(file.view()));
+}
+
+std::string_view getStoredContent(std::string_view rawContent){
+    if(!isChunkedContent(rawContent) && rawContent.size() > 0 && rawContent.back() == '\n'){
+        // Remove final newline
+        rawContent.remove_suffix(1);
+    }
+
+    return rawContent;
+}
+
+int parseLineNumber(std::string_view changeLine){
+    int lineNum = 0;
+
+    std::from_chars(changeLine.data(), changeLine.data() + changeLine.size(), lineNum);
+
+    return lineNum;
+}
+
+// Function for writing the "N:" that starts a change line
+// Returns the prefix, which lives in the buffer
+// buffer -> where to write it
+// lineNum -> the line number
+static std::string_view getChangePrefix(char (&buffer)[24], size_t lineNum){
+    char* prefixEnd = std::to_chars(buffer, buffer + sizeof(buffer) - 1, lineNum).ptr;
+    *prefixEnd++ = ':';
+
+    return std::string_view(buffer, prefixEnd - buffer);
+}
+
+LineTable getChanges(std::string_view file1Contents, std::string_view file2Contents){
+    TRACE_SPAN("getChanges", TRACE_DIFF);
+    LineTable changes;
+    char prefix[24];
 
     // If either are empty, return the other as a change
 
     if(file1Contents == ""){
         // Return the entirety of file2 as a change
-        std::istringstream file2Stream(file2Contents);
-        
-        std::string line;
-        int counter = 0;
-        while(std::getline(file2Stream, line)){
-            counter++;
-            changes.push_back(std::to_string(counter) + ":" + line);
+        LineTable file2Lines(file2Contents);
+
+        for(size_t i=0; i<file2Lines.size(); i++){
+            changes.push_back(getChangePrefix(prefix, i+1), file2Lines[i]);
         }
 
         return changes;
@@ -53,42 +126,28 @@ std::vector<std::string> getChanges(std::string file1Contents, std::string file2
 
     if(file2Contents == ""){
         // Return the entirety of file1 as a change
-        std::istringstream file1Stream(file1Contents);
+        LineTable file1Lines(file1Contents);
 
-        std::string line;
-        int counter = 0;
-        while(std::getline(file1Stream, line)){
-            counter++;
-            changes.push_back(std::to_string(counter) + ":" + line);
+        for(size_t i=0; i<file1Lines.size(); i++){
+            changes.push_back(getChangePrefix(prefix, i+1), file1Lines[i]);
         }
 
         return changes;
     }
 
-    std::vector<std::string> oldLines;
-    std::vector<std::string> newLines;
-
-    std::istringstream oldStream(file1Contents);
-    std::string line;
-
-    while(std::getline(oldStream, line)){
-        oldLines.push_back(line);
-    }
-
-    std::istringstream newStream(file2Contents);
-    while(std::getline(newStream, line)){
-        newLines.push_back(line);
-    }
+    // The lines point into the contents, and changes are copied into the one arena
+    LineTable oldLines(file1Contents);
+    LineTable newLines(file2Contents);
 
     // Use the biggest size to avoid.. issues
     size_t maxLines = std::max(oldLines.size(), newLines.size());
 
     for(size_t i=0; i<maxLines; i++){
-        std::string oldLine = (i < oldLines.size() ? oldLines[i] : "");
-        std::string newLine = (i < newLines.size() ? newLines[i] : "");
+        std::string_view oldLine = (i < oldLines.size() ? oldLines[i] : std::string_view());
+        std::string_view newLine = (i < newLines.size() ? newLines[i] : std::string_view());
 
         if(oldLine != newLine){
-            changes.push_back(std::to_string(i+1) + ":" + newLine);
+            changes.push_back(getChangePrefix(prefix, i+1), newLine);
         }
     }
 
@@ -2,8 +2,11 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "lineTable.h"
+
 // Struct for storing the changes made to a file
 struct Change{
     int lineNum;
@@ -15,15 +18,34 @@ std::string getDateTime();
 
 // Function for reconstructing strings that have been split by newlines
 // splitString -> the vector of strings to be reconstructed
-std::string reconstructSplitString(std::vector<std::string> splitString);
+std::string reconstructSplitString(const std::vector<std::string>& splitString);
+
+// Function for joining the lines of a line table back together with newlines
+// lines -> the lines to join
+std::string reconstructSplitString(const LineTable& lines);
 
 // Function for checking if a file exists
 // filePath -> path to the file to check
 bool doesFileExist(std::string filePath);
 
+// Function for reading a file's content the way it is stored in saves
+// Text files lose their final newline (lines are stored without one), large or binary files are kept byte for byte
+// filePath -> path to the file to read
+std::string readFileContent(std::string filePath);
+
+// Function for trimming a file's bytes to the way they're stored in saves (see readFileContent), without copying
+// rawContent -> the file's bytes
+std::string_view getStoredContent(std::string_view rawContent);
+
+// Function for parsing the line number at the start of an "N:content" change line
+// Returns 0 if there isn't one
+// changeLine -> the change line
+int parseLineNumber(std::string_view changeLine);
+
 // Function for getting changes between two files (line-by-line, update to Myer's diff pls and thanks)
+// Returns the changes as "N:content" lines
 // file1 -> the first file's contents
 // file2 -> the second file's contents
-std::vector<std::string> getChanges(std::string file1Contents, std::string file2Contents);
+LineTable getChanges(std::string_view file1Contents, std::string_view file2Contents);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include <set>
+#include <unordered_map>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+
+#include "watcher.h"
+#include "networkUtils.h"
+#include "logger.h"
+
+#ifdef __linux__
+    #include <sys/inotify.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <cstring>
+#endif
+
+#ifdef __linux__
+
+// Events that mean a tracked file may have changed
+#define WATCH_FILE_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+// Events that mean a watched directory itself has gone, so its watch no longer sees the files at its path
+#define WATCH_DIR_GONE_EVENTS (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)
+
+// How long to wait before trying again when a directory can't be watched (in milliseconds)
+#define WATCH_RETRY_DELAY_MS 5000
+
+static volatile sig_atomic_t watcherStopping = 0;
+
+// Function for stopping the watcher's loop from a signal handler
+static void stopWatcher(int){
+    watcherStopping = 1;
+}
+
+// Struct for storing the watcher's view of the project
+struct WatcherState{
+    int inotifyFD;
+    int cupyWatch;
+    int savesWatch;
+
+    // Directories of tracked files, by watch descriptor (the same directory can be reached by more than one path)
+    std::unordered_map<int, std::vector<std::string>> watchedDirs;
+
+    std::set<std::string> trackedFiles;
+    std::set<std::string> changedFiles;
+
+    // False from the moment .cupy changes until the next rescan finishes
+    bool upToDate;
+    std::chrono::steady_clock::time_point rescanAt;
+};
+
+// Function for delaying the next rescan until .cupy has been quiet for a while
+// state -> the watcher's state
+// delayMs -> how long to wait
+static void scheduleRescan(WatcherState& state, int delayMs = WATCH_RESCAN_DELAY_MS){
+    state.upToDate = false;
+    state.rescanAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+}
+
+// Function for re-reading the tracked files, re-adding the watches and checking every tracked file
+// Watches are added before the files are checked, so any change made during the rescan is still seen
+// If a directory can't be watched the watcher stays stale (so clients do full scans) and tries again later
+// state -> the watcher's state
+// getTrackedFiles -> gives the tracked files
+// hasFileChanged -> checks a file against the last save
+static void rescan(WatcherState& state, TrackedFilesGetter getTrackedFiles, FileChangeCheck hasFileChanged){
+    for(auto& watchedDir : state.watchedDirs){
+        inotify_rm_watch(state.inotifyFD, watchedDir.first);
+    }
+
+    state.watchedDirs.clear();
+
+    std::vector<std::string> trackedFiles = getTrackedFiles();
+    state.trackedFiles = std::set<std::string>(trackedFiles.begin(), trackedFiles.end());
+
+    std::set<std::string> dirPaths;
+    for(const std::string& trackedFile : state.trackedFiles){
+        size_t splitPos = trackedFile.find_last_of('/');
+
+        dirPaths.insert(splitPos == std::string::npos ? "." : trackedFile.substr(0, splitPos));
+    }
+
+    bool allWatched = true;
+
+    for(const std::string& dirPath : dirPaths){
+        int watch = inotify_add_watch(state.inotifyFD, dirPath.c_str(), WATCH_FILE_EVENTS | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+
+        if(watch < 0){
+            error("Cannot watch " + dirPath + ": " + std::strerror(errno));
+            allWatched = false;
+            continue;
+        }
+
+        state.watchedDirs[watch].push_back(dirPath);
+    }
+
+    if(!allWatched){
+        // Changes in that directory would go unseen, so answer "stale" rather than miss them
+        scheduleRescan(state, WATCH_RETRY_DELAY_MS);
+        return;
+    }
+
+    state.changedFiles.clear();
+
+    for(const std::string& trackedFile : state.trackedFiles){
+        if(hasFileChanged(trackedFile)){
+            state.changedFiles.insert(trackedFile);
+        }
+    }
+
+    state.upToDate = true;
+
+    log("Watching " + std::to_string(state.trackedFiles.size()) + " tracked file(s) in " + std::to_string(dirPaths.size()) + " directory(s), " + std::to_string(state.changedFiles.size()) + " changed");
+}
+
+// Function for applying a buffer of inotify events
+// state -> the watcher's state
+// buffer -> the events, as read from the inotify descriptor
+// length -> bytes of events in the buffer
+static void applyEvents(WatcherState& state, const char* buffer, ssize_t length){
+    for(ssize_t offset=0; offset < length;){
+        const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+
+        std::string name = event->len > 0 ? event->name : "";
+
+        if(event->mask & IN_Q_OVERFLOW){
+            // Events were lost, so nothing can be trusted until everything has been checked again
+            error("inotify queue overflowed, rescanning");
+            scheduleRescan(state);
+
+        }else if(event->wd == state.savesWatch){
+            // A save was made or obliterated
+            scheduleRescan(state);
+
+        }else if(event->wd == state.cupyWatch){
+            if(name == ".track"){
+                scheduleRescan(state);
+            }
+
+        }else{
+            auto found = state.watchedDirs.find(event->wd);
+
+            if(found == state.watchedDirs.end()){
+                continue;
+            }
+
+            if(event->mask & WATCH_DIR_GONE_EVENTS){
+                // The directory was moved, deleted or replaced, so its path needs watching again
+                scheduleRescan(state);
+                continue;
+            }
+
+            for(const std::string& dirPath : found->second){
+                std::string filePath = dirPath + "/" + name;
+
+                if(state.trackedFiles.count(filePath) > 0){
+                    state.changedFiles.insert(filePath);
+                }
+            }
+        }
+    }
+}
+
+// Function for reading and applying every waiting inotify event
+// Reads until the descriptor is empty, so a query is never answered with events still waiting
+// state -> the watcher's state
+static void readEvents(WatcherState& state){
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    while(true){
+        ssize_t length = read(state.inotifyFD, buffer, sizeof(buffer));
+
+        if(length <= 0){
+            // EAGAIN once everything has been read
+            break;
+        }
+
+        applyEvents(state, buffer, length);
+    }
+}
+
+// Function for answering a query from a client
+// state -> the watcher's state
+// clientFD -> socket of the client
+static void answerQuery(WatcherState& state, int clientFD){
+    // Don't let a stuck client hold up the watcher
+    struct timeval timeout = {1, 0};
+    setsockopt(clientFD, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(clientFD, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    try{
+        std::string command = receiveMessage(clientFD);
+
+        if(command == "ping"){
+            // Another watcher checking if this one is running, it doesn't wait for a reply
+
+        }else if(command != "changed"){
+            sendMessage(clientFD, "unknown");
+
+        }else if(!state.upToDate){
+            sendMessage(clientFD, "stale");
+
+        }else{
+            sendMessage(clientFD, "ok");
+            sendMessage(clientFD, std::to_string(state.changedFiles.size()));
+
+            for(const std::string& changedFile : state.changedFiles){
+                sendMessage(clientFD, changedFile);
+            }
+        }
+
+    }catch(std::exception& err){
+        error(std::string("Query failed: ") + err.what());
+    }
+
+    close(clientFD);
+}
+
+// Function for connecting to the watcher's socket
+// Returns the socket, or -1 if there's no watcher listening
+static int connectToWatcher(){
+    int socketFD = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(socketFD < 0){
+        return -1;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, WATCH_SOCKET_PATH, sizeof(address.sun_path) - 1);
+
+    if(connect(socketFD, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+        close(socketFD);
+        return -1;
+    }
+
+    return socketFD;
+}
+
+int runWatcher(TrackedFilesGetter getTrackedFiles, FileChangeCheck hasFileChanged){
+    int existingFD = connectToWatcher();
+
+    if(existingFD >= 0){
+        sendMessage(existingFD, "ping");
+        close(existingFD);
+        error("A watcher is already running for this project");
+        return -1;
+    }
+
+    // Nothing is listening, so any socket file left behind is from a watcher that didn't shut down cleanly
+    unlink(WATCH_SOCKET_PATH);
+
+    int listenFD = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, WATCH_SOCKET_PATH, sizeof(address.sun_path) - 1);
+
+    if(listenFD < 0 || bind(listenFD, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFD, 16) != 0){
+        error(std::string("Cannot listen on " WATCH_SOCKET_PATH ": ") + std::strerror(errno));
+        return -1;
+    }
+
+    WatcherState state;
+    state.inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if(state.inotifyFD < 0){
+        error(std::string("inotify_init1() failed: ") + std::strerror(errno));
+        close(listenFD);
+        unlink(WATCH_SOCKET_PATH);
+        return -1;
+    }
+
+    state.cupyWatch = inotify_add_watch(state.inotifyFD, ".cupy", IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+    state.savesWatch = inotify_add_watch(state.inotifyFD, ".cupy/saves", IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM);
+
+    // No SA_RESTART, so the signals interrupt poll()
+    struct sigaction stopAction = {};
+    stopAction.sa_handler = stopWatcher;
+    sigaction(SIGINT, &stopAction, nullptr);
+    sigaction(SIGTERM, &stopAction, nullptr);
+
+    // A client going away mid-reply shouldn't kill the watcher
+    signal(SIGPIPE, SIG_IGN);
+
+    rescan(state, getTrackedFiles, hasFileChanged);
+
+    log("Listening on " WATCH_SOCKET_PATH ", press Ctrl+C to stop");
+
+    while(!watcherStopping){
+        int timeoutMs = -1;
+
+        if(!state.upToDate){
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(state.rescanAt - std::chrono::steady_clock::now());
+            timeoutMs = std::max<long long>(0, wait.count());
+        }
+
+        struct pollfd pollFDs[2] = {{state.inotifyFD, POLLIN, 0}, {listenFD, POLLIN, 0}};
+
+        int ready = poll(pollFDs, 2, timeoutMs);
+
+        if(ready < 0 && errno != EINTR){
+            error(std::string("poll() failed: ") + std::strerror(errno));
+            break;
+        }
+
+        if(ready > 0 && (pollFDs[0].revents & POLLIN)){
+            readEvents(state);
+        }
+
+        if(!state.upToDate && std::chrono::steady_clock::now() >= state.rescanAt){
+            rescan(state, getTrackedFiles, hasFileChanged);
+        }
+
+        if(ready > 0 && (pollFDs[1].revents & POLLIN)){
+            int clientFD = accept(listenFD, nullptr, nullptr);
+
+            if(clientFD >= 0){
+                // Events that came in since poll() returned must count towards the answer
+                readEvents(state);
+                answerQuery(state, clientFD);
+            }
+        }
+    }
+
+    log("Stopping watcher");
+
+    close(state.inotifyFD);
+    close(listenFD);
+    unlink(WATCH_SOCKET_PATH);
+
+    return 0;
+}
+
+bool queryWatcher(std::vector<std::string>& changedFiles){
+    int socketFD = connectToWatcher();
+
+    if(socketFD < 0){
+        return false;
+    }
+
+    try{
+        sendMessage(socketFD, "changed");
+
+        if(receiveMessage(socketFD) != "ok"){
+            close(socketFD);
+            return false;
+        }
+
+        int count = std::stoi(receiveMessage(socketFD));
+
+        changedFiles.clear();
+
+        for(int i=0; i<count; i++){
+            changedFiles.push_back(receiveMessage(socketFD));
+        }
+
+    }catch(std::exception& err){
+        // Whatever went wrong, a full scan still gives the right answer
+        close(socketFD);
+        return false;
+    }
+
+    close(socketFD);
+
+    return true;
+}
+
+#else
+
+int runWatcher(TrackedFilesGetter getTrackedFiles, FileChangeCheck hasFileChanged){
+    error("cvcs watch needs inotify, which is only available on Linux");
+    return -1;
+}
+
+bool queryWatcher(std::vector<std::string>& changedFiles){
+    return false;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Unix socket the watcher listens on, relative to the project directory
+#define WATCH_SOCKET_PATH ".cupy/watch.sock"
+
+// How long .cupy has to be quiet after a save, add or ignore before the watcher rescans (in milliseconds)
+#define WATCH_RESCAN_DELAY_MS 500
+
+// Function type for getting the tracked files
+typedef std::function<std::vector<std::string>()> TrackedFilesGetter;
+
+// Function type for checking if a file has changed since the last save
+typedef std::function<bool(std::string)> FileChangeCheck;
+
+// Function for running the watcher daemon in the current project until it gets SIGINT or SIGTERM
+// Keeps the set of tracked files that may have changed since the last save up to date with inotify, and answers
+// queries for it on WATCH_SOCKET_PATH. After anything in .cupy changes (or inotify overflows) it answers "stale"
+// until it has rescanned every tracked file
+// Returns 0 when stopped, or a negative number if it couldn't start
+// getTrackedFiles -> gives the tracked files
+// hasFileChanged -> checks a file against the last save (used for the rescans)
+int runWatcher(TrackedFilesGetter getTrackedFiles, FileChangeCheck hasFileChanged);
+
+// Function for asking a running watcher which tracked files may have changed since the last save
+// Returns false if there's no watcher or it's rescanning, in which case every file needs checking
+// changedFiles -> set to the files that may have changed (a superset, so each still needs checking)
+bool queryWatcher(std::vector<std::string>& changedFiles);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+// Queue with a maximum size for handing work between threads
+// push() waits while the queue is full, pop() waits while it's empty until close() is called
+template <typename T>
+class BoundedQueue{
+public:
+    // capacity -> most items the queue holds before push() waits
+    BoundedQueue(size_t capacity) : capacity(capacity), closed(false){
+    }
+
+    // Function for adding an item, waiting for space if the queue is full
+    // item -> the item to add
+    void push(T item){
+        std::unique_lock<std::mutex> lock(mutex);
+
+        notFull.wait(lock, [this](){
+            return items.size() < capacity || closed;
+        });
+
+        items.push_back(std::move(item));
+
+        notEmpty.notify_one();
+    }
+
+    // Function for taking the next item, waiting for one if the queue is empty
+    // Returns false once the queue has been closed and everything in it taken
+    // item -> set to the item taken
+    bool pop(T& item){
+        std::unique_lock<std::mutex> lock(mutex);
+
+        notEmpty.wait(lock, [this](){
+            return !items.empty() || closed;
+        });
+
+        if(items.empty()){
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+
+        notFull.notify_one();
+
+        return true;
+    }
+
+    // Function for marking that nothing else will be pushed
+    void close(){
+        std::lock_guard<std::mutex> lock(mutex);
+
+        closed = true;
+
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    size_t capacity;
+    bool closed;
+
+    std::deque<T> items;
+
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
+
+#endif